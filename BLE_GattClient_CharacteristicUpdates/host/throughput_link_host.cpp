@@ -0,0 +1,257 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include "throughput_meter.h"
+
+/** Run the notification throughput sweep against a simulated link on a host.
+ *
+ * The server streams notifications as the throughput service of
+ * BLE_GattServer_CharacteristicUpdates does: a payload capped by the ATT_MTU,
+ * starting with a sequence number and the send time, and a fixed number of
+ * notifications in flight. The simulated link carries them in connection
+ * events, split in link layer packets of the data length, and retransmits the
+ * packets lost. The client measures them with the throughput::Meter used by
+ * the benchmark on the boards.
+ *
+ * Unlike the boards, the host can set the ATT_MTU and the data length, so they
+ * are swept along with the PHY, the connection interval and the payload
+ * length. Results are reproducible, the losses come from a seeded generator.
+ */
+
+/* demo config */
+
+/* same sweep as ThroughputBenchmark, plus the ATT_MTU and the data length */
+static const uint16_t ATT_MTUS[] = { 23, 247 };
+static const uint16_t DATA_LENGTHS[] = { 27, 251 };
+static const struct {
+    const char *name;
+    /* time on air of a byte in microseconds */
+    uint32_t byte_air_time_us;
+    /* preamble, access address, header and CRC, in bytes */
+    uint32_t overhead;
+} PHYS[] = {
+    { "1M", 8, 1 + 4 + 2 + 3 },
+    { "2M", 4, 2 + 4 + 2 + 3 }
+};
+/* in units of 1.25 ms: 7.5, 15, 30 and 50 ms */
+static const uint16_t INTERVALS[] = { 6, 12, 24, 40 };
+static const uint16_t PAYLOADS[] = { 20, 64, 128, 244 };
+
+/* default of throughput-measure-time-ms and settle time of the benchmark */
+static const uint32_t MEASURE_TIME_US = 3000000;
+static const uint32_t SETTLE_TIME_US = 500000;
+
+/* default of throughput-notifications-in-flight */
+static const size_t NOTIFICATIONS_IN_FLIGHT = 8;
+
+/* packet error rate of the link in per mille */
+static const uint32_t PER_PERMILLE = 10;
+
+/* time the server takes to queue a new notification once the controller
+ * reported the previous ones sent, at the end of the connection event */
+static const uint32_t HOST_LATENCY_US = 500;
+
+/* config end */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+/* interframe space */
+static const uint32_t T_IFS_US = 150;
+
+/* ATT header of a notification and L2CAP header */
+static const uint16_t NOTIFICATION_OVERHEAD = 3 + 4;
+
+/* payload length check of ThroughputService::onDataWritten */
+static const uint16_t MAX_PAYLOAD = 244;
+
+static uint32_t random_state = 0x5EED1234;
+
+static uint32_t next_random()
+{
+    /* xorshift32 */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static void write_u32(uint8_t *data, uint32_t value)
+{
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+struct link_t {
+    uint16_t att_mtu;
+    uint16_t data_length;
+    size_t phy;
+    /* in units of 1.25 ms */
+    uint16_t interval;
+};
+
+/** Notifications queued by the server and sent over the simulated link */
+class SimulatedLink {
+public:
+    SimulatedLink(const link_t &link, uint16_t payload, uint32_t now_us) :
+        _link(link),
+        _payload(payload),
+        _anchor_us(now_us)
+    {
+        queue_notifications(now_us);
+    }
+
+    /**
+     * Run the connection events up to a time, notifications received are
+     * handed to the meter.
+     */
+    void run_until(uint32_t end_us, throughput::Meter &meter)
+    {
+        uint32_t interval_us = _link.interval * 1250;
+        uint32_t byte_air_time_us = PHYS[_link.phy].byte_air_time_us;
+        uint32_t overhead = PHYS[_link.phy].overhead;
+        /* the central opens each exchange with an empty packet */
+        uint32_t empty_us = overhead * byte_air_time_us;
+
+        while (_anchor_us < end_us) {
+            uint32_t now_us = _anchor_us;
+            size_t completed = 0;
+
+            while (_queued) {
+                notification_t &head = _queue[_head];
+                uint16_t fragment = head.left < _link.data_length ? head.left : _link.data_length;
+                uint32_t packet_us = (overhead + fragment) * byte_air_time_us;
+                uint32_t exchange_us = empty_us + T_IFS_US + packet_us + T_IFS_US;
+
+                /* the event closes before the next anchor */
+                if (now_us + exchange_us > _anchor_us + interval_us) {
+                    break;
+                }
+                now_us += exchange_us;
+
+                /* the packet is sent again in the next exchange */
+                if (next_random() % 1000 < PER_PERMILLE) {
+                    continue;
+                }
+
+                head.left -= fragment;
+                if (!head.left) {
+                    meter.on_notification(head.data, _payload, now_us - T_IFS_US);
+                    _head = (_head + 1) % NOTIFICATIONS_IN_FLIGHT;
+                    _queued--;
+                    completed++;
+                }
+            }
+
+            /* the controller reports the notifications sent at the end of the
+             * event, each one makes room for the next */
+            if (completed) {
+                queue_notifications(now_us + HOST_LATENCY_US);
+            }
+
+            _anchor_us += interval_us;
+        }
+    }
+
+private:
+    struct notification_t {
+        uint8_t data[MAX_PAYLOAD];
+        /* bytes left to send, headers included */
+        uint16_t left;
+    };
+
+    /* ThroughputService::stream() */
+    void queue_notifications(uint32_t now_us)
+    {
+        while (_queued < NOTIFICATIONS_IN_FLIGHT) {
+            notification_t &notification = _queue[(_head + _queued) % NOTIFICATIONS_IN_FLIGHT];
+            write_u32(notification.data, _sequence);
+            write_u32(notification.data + 4, now_us);
+            notification.left = NOTIFICATION_OVERHEAD + _payload;
+            _queued++;
+            _sequence++;
+        }
+    }
+
+    link_t _link;
+    uint16_t _payload;
+    uint32_t _anchor_us;
+    uint32_t _sequence = 0;
+
+    notification_t _queue[NOTIFICATIONS_IN_FLIGHT];
+    size_t _head = 0;
+    size_t _queued = 0;
+};
+
+int main()
+{
+    throughput::Meter meter;
+    uint32_t now_us = 0;
+
+    printf("ATT_MTU | PHY | interval (ms) | payload | data length tx/rx | notifications | lost | goodput (kbps) | latency mean/max (ms)\r\n");
+
+    for (uint16_t att_mtu : ATT_MTUS) {
+        for (uint16_t data_length : DATA_LENGTHS) {
+            for (size_t phy = 0; phy < ARRAY_SIZE(PHYS); ++phy) {
+                for (uint16_t interval : INTERVALS) {
+                    uint16_t previous_payload = 0;
+                    for (uint16_t payload : PAYLOADS) {
+                        // capped as ThroughputBenchmark::start() and
+                        // ThroughputService::onDataWritten() do
+                        if (payload > att_mtu - 3) {
+                            payload = att_mtu - 3;
+                        }
+                        if (payload == previous_payload) {
+                            continue;
+                        }
+                        previous_payload = payload;
+
+                        link_t link = { att_mtu, data_length, phy, interval };
+                        SimulatedLink simulated_link(link, payload, now_us);
+
+                        simulated_link.run_until(now_us + SETTLE_TIME_US, meter);
+                        now_us += SETTLE_TIME_US;
+                        meter.reset(now_us);
+                        simulated_link.run_until(now_us + MEASURE_TIME_US, meter);
+                        now_us += MEASURE_TIME_US;
+
+                        throughput::result_t result = meter.result(now_us);
+                        unsigned interval_us = interval * 1250;
+                        printf(
+                            "%u | %s | %u.%02u | %u | %u/%u | %lu | %lu | %lu | %lu.%03lu/%lu.%03lu\r\n",
+                            att_mtu,
+                            PHYS[phy].name,
+                            interval_us / 1000, (interval_us % 1000) / 10,
+                            payload,
+                            data_length, data_length,
+                            (unsigned long) result.notifications,
+                            (unsigned long) result.lost,
+                            (unsigned long) (result.goodput_bps() / 1000),
+                            (unsigned long) (result.mean_latency_us / 1000),
+                            (unsigned long) (result.mean_latency_us % 1000),
+                            (unsigned long) (result.max_latency_us / 1000),
+                            (unsigned long) (result.max_latency_us % 1000)
+                        );
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
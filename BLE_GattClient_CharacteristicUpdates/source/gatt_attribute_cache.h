@@ -0,0 +1,186 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GATT_ATTRIBUTE_CACHE_H_
+#define GATT_ATTRIBUTE_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ble/BLE.h"
+#include "ble/GattClient.h"
+
+/**
+ * Layout of the GATT servers of the peers the client connected to.
+ *
+ * An entry records the characteristics discovered and the handle of their
+ * CCCD along with the Database Hash of the server at the time of the
+ * discovery. When the client reconnects to the peer it reads the Database
+ * Hash again: if it didn't change the layout cached is still valid and the
+ * discovery can be skipped.
+ *
+ * Servers without a Database Hash characteristic are never cached as there
+ * is no way to find out if their layout changed.
+ *
+ * The cache lives in RAM, it lasts until the application is reset. When it is
+ * full the entry used the longest time ago is replaced.
+ *
+ * @tparam Peers Number of peers which can be cached.
+ * @tparam Characteristics Maximum number of characteristics of a peer.
+ */
+template<size_t Peers, size_t Characteristics>
+class GattAttributeCache {
+public:
+    static const size_t DATABASE_HASH_SIZE = 16;
+
+    struct characteristic_t {
+        UUID uuid;
+        DiscoveredCharacteristic::Properties_t properties;
+        GattAttribute::Handle_t decl_handle;
+        GattAttribute::Handle_t value_handle;
+        GattAttribute::Handle_t last_handle;
+        /* 0 if the characteristic doesn't have a CCCD */
+        GattAttribute::Handle_t cccd_handle;
+    };
+
+    struct entry_t {
+        ble::peer_address_type_t address_type;
+        ble::address_t address;
+        GattAttribute::Handle_t database_hash_handle;
+        uint8_t database_hash[DATABASE_HASH_SIZE];
+        size_t characteristic_count;
+        characteristic_t characteristics[Characteristics];
+    };
+
+    /**
+     * Find the entry of a peer.
+     *
+     * @return nullptr if the peer isn't in the cache.
+     */
+    entry_t *find(ble::peer_address_type_t address_type, const ble::address_t &address)
+    {
+        for (size_t i = 0; i < Peers; ++i) {
+            if (_last_use[i] && _entries[i].address_type == address_type && _entries[i].address == address) {
+                _last_use[i] = ++_use_count;
+                return &_entries[i];
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Get an entry to record the layout of a peer.
+     *
+     * The entry returned is either the previous entry of the peer or the one
+     * used the longest time ago; its characteristics are cleared.
+     */
+    entry_t &store(ble::peer_address_type_t address_type, const ble::address_t &address)
+    {
+        size_t slot = 0;
+        for (size_t i = 0; i < Peers; ++i) {
+            if (_last_use[i] && _entries[i].address_type == address_type && _entries[i].address == address) {
+                slot = i;
+                break;
+            }
+            if (_last_use[i] < _last_use[slot]) {
+                slot = i;
+            }
+        }
+
+        entry_t &entry = _entries[slot];
+        entry.address_type = address_type;
+        entry.address = address;
+        entry.database_hash_handle = GattAttribute::INVALID_HANDLE;
+        entry.characteristic_count = 0;
+        _last_use[slot] = ++_use_count;
+
+        return entry;
+    }
+
+    /**
+     * Remove the entry of a peer.
+     *
+     * @return false if the peer wasn't in the cache.
+     */
+    bool invalidate(ble::peer_address_type_t address_type, const ble::address_t &address)
+    {
+        for (size_t i = 0; i < Peers; ++i) {
+            if (_last_use[i] && _entries[i].address_type == address_type && _entries[i].address == address) {
+                _last_use[i] = 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** Check if the Database Hash read from the server is the one cached */
+    static bool is_valid(const entry_t &entry, const uint8_t *database_hash, size_t size)
+    {
+        return size == DATABASE_HASH_SIZE &&
+            memcmp(entry.database_hash, database_hash, DATABASE_HASH_SIZE) == 0;
+    }
+
+    /** Record a characteristic discovered in an entry */
+    static bool add(entry_t &entry, const DiscoveredCharacteristic &characteristic, GattAttribute::Handle_t cccd_handle)
+    {
+        if (entry.characteristic_count == Characteristics) {
+            return false;
+        }
+
+        characteristic_t &c = entry.characteristics[entry.characteristic_count++];
+        c.uuid = characteristic.getUUID();
+        c.properties = characteristic.getProperties();
+        c.decl_handle = characteristic.getDeclHandle();
+        c.value_handle = characteristic.getValueHandle();
+        c.last_handle = characteristic.getLastHandle();
+        c.cccd_handle = cccd_handle;
+
+        return true;
+    }
+
+    /** Rebuild a characteristic of an entry for the connection in input */
+    static void restore(
+        const characteristic_t &c,
+        GattClient *client,
+        ble::connection_handle_t connection_handle,
+        DiscoveredCharacteristic &characteristic
+    )
+    {
+        if (c.uuid.shortOrLong() == UUID::UUID_TYPE_SHORT) {
+            characteristic.setup(
+                client, connection_handle, c.uuid.getShortUUID(), c.properties,
+                c.decl_handle, c.value_handle, c.last_handle
+            );
+        } else {
+            characteristic.setup(
+                client, connection_handle, c.properties,
+                c.decl_handle, c.value_handle, c.last_handle
+            );
+            UUID::LongUUIDBytes_t uuid;
+            memcpy(uuid, c.uuid.getBaseUUID(), UUID::LENGTH_OF_LONG_UUID);
+            characteristic.setupLongUUID(uuid, UUID::LSB);
+        }
+    }
+
+private:
+    entry_t _entries[Peers];
+    /* 0 for free entries */
+    uint32_t _last_use[Peers] = { 0 };
+    uint32_t _use_count = 0;
+};
+
+#endif // GATT_ATTRIBUTE_CACHE_H_
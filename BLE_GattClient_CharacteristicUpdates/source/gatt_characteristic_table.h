@@ -0,0 +1,302 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GATT_CHARACTERISTIC_TABLE_H_
+#define GATT_CHARACTERISTIC_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ble/BLE.h"
+#include "ble/GattClient.h"
+
+/**
+ * Set of distinct 128-bit UUID bases, each one referenced by its index.
+ *
+ * A base is a 128-bit UUID with its 16-bit part, bytes 12 and 13 in little
+ * endian order, set to 0. Vendor services usually derive all their UUIDs from
+ * one base by changing these bytes, a base is stored once however many
+ * characteristics use it. Lookups are linear, the set is expected to stay
+ * small.
+ *
+ * @tparam Capacity Maximum number of distinct bases.
+ */
+template<size_t Capacity>
+class UuidBaseTable {
+public:
+    static const uint8_t NOT_FOUND = UINT8_MAX;
+
+    static_assert(Capacity < NOT_FOUND, "base indexes are stored on 8 bits");
+
+    void clear()
+    {
+        _size = 0;
+    }
+
+    /**
+     * Get the index of a base, adding it if it isn't in the set.
+     *
+     * @return NOT_FOUND if the base is new and the set is full.
+     */
+    uint8_t intern(const uint8_t *base)
+    {
+        for (size_t i = 0; i < _size; ++i) {
+            if (memcmp(_bases[i], base, UUID::LENGTH_OF_LONG_UUID) == 0) {
+                return i;
+            }
+        }
+
+        if (_size == Capacity) {
+            return NOT_FOUND;
+        }
+
+        memcpy(_bases[_size], base, UUID::LENGTH_OF_LONG_UUID);
+        return _size++;
+    }
+
+    const uint8_t *get(uint8_t index) const
+    {
+        return _bases[index];
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+private:
+    size_t _size = 0;
+    UUID::LongUUIDBytes_t _bases[Capacity];
+};
+
+/**
+ * Compact storage of the characteristics discovered on a server.
+ *
+ * A characteristic is stored as a packed record: its handles, its properties
+ * packed in a byte and its UUID. A 16-bit UUID is stored as is. A 128-bit UUID
+ * is stored as the index of its base in a UuidBaseTable and its 16-bit part.
+ * A record takes RECORD_SIZE bytes instead of a full DiscoveredCharacteristic,
+ * which repeats the GattClient, the connection handle and a 16 byte UUID for
+ * each one.
+ *
+ * Once the base table is full, the 128-bit UUIDs with a new base are stored in
+ * full. Records fill the storage from the start and these UUIDs from the end,
+ * each one takes 16 bytes of room: the table holds fewer characteristics but
+ * the discovery goes on.
+ *
+ * The DiscoveredCharacteristic used to operate on a characteristic is
+ * rebuilt on demand with get().
+ *
+ * @tparam Capacity Maximum number of characteristics.
+ * @tparam BaseCapacity Maximum number of distinct 128-bit UUID bases.
+ */
+template<size_t Capacity, size_t BaseCapacity>
+class GattCharacteristicTable {
+public:
+    typedef DiscoveredCharacteristic::Properties_t Properties_t;
+
+    /* bytes used by a characteristic: 3 handles, properties, UUID kind and 16-bit UUID */
+    static const size_t RECORD_SIZE = 3 * sizeof(GattAttribute::Handle_t) + 2 * sizeof(uint8_t) + sizeof(uint16_t);
+
+    /** Remove all the characteristics and UUIDs */
+    void clear()
+    {
+        _size = 0;
+        _full_uuids = 0;
+        _bases.clear();
+    }
+
+    /**
+     * Append a characteristic.
+     *
+     * @return false if there is no room left in the table.
+     */
+    bool add(const DiscoveredCharacteristic &characteristic)
+    {
+        if (!room_left(0)) {
+            return false;
+        }
+
+        const UUID &uuid = characteristic.getUUID();
+        uint8_t kind = SHORT_UUID;
+        uint16_t value = 0;
+
+        if (uuid.shortOrLong() == UUID::UUID_TYPE_SHORT) {
+            value = uuid.getShortUUID();
+        } else {
+            const uint8_t *bytes = uuid.getBaseUUID();
+            UUID::LongUUIDBytes_t base;
+            memcpy(base, bytes, UUID::LENGTH_OF_LONG_UUID);
+            base[SHORT_PART_OFFSET] = 0;
+            base[SHORT_PART_OFFSET + 1] = 0;
+
+            kind = _bases.intern(base);
+            if (kind != UuidBaseTable<BaseCapacity>::NOT_FOUND) {
+                value = bytes[SHORT_PART_OFFSET] | (bytes[SHORT_PART_OFFSET + 1] << 8);
+            } else {
+                // no base left, the UUID is stored in full
+                if (!room_left(UUID::LENGTH_OF_LONG_UUID)) {
+                    return false;
+                }
+                kind = FULL_UUID;
+                value = _full_uuids++;
+                memcpy(full_uuid(value), bytes, UUID::LENGTH_OF_LONG_UUID);
+            }
+        }
+
+        uint8_t *record = _storage + _size * RECORD_SIZE;
+        write_u16(record, characteristic.getDeclHandle());
+        write_u16(record + 2, characteristic.getValueHandle());
+        write_u16(record + 4, characteristic.getLastHandle());
+        record[6] = pack(characteristic.getProperties());
+        record[7] = kind;
+        write_u16(record + 8, value);
+        _size++;
+        return true;
+    }
+
+    /** Rebuild a characteristic for the connection in input */
+    void get(
+        size_t index,
+        GattClient *client,
+        ble::connection_handle_t connection_handle,
+        DiscoveredCharacteristic &characteristic
+    ) const
+    {
+        const uint8_t *record = _storage + index * RECORD_SIZE;
+        GattAttribute::Handle_t decl_handle = read_u16(record);
+        GattAttribute::Handle_t value_handle = read_u16(record + 2);
+        GattAttribute::Handle_t last_handle = read_u16(record + 4);
+        Properties_t properties = unpack(record[6]);
+        uint8_t kind = record[7];
+        uint16_t value = read_u16(record + 8);
+
+        if (kind == SHORT_UUID) {
+            characteristic.setup(
+                client, connection_handle, value, properties,
+                decl_handle, value_handle, last_handle
+            );
+            return;
+        }
+
+        characteristic.setup(
+            client, connection_handle, properties,
+            decl_handle, value_handle, last_handle
+        );
+
+        UUID::LongUUIDBytes_t long_uuid;
+        if (kind == FULL_UUID) {
+            memcpy(long_uuid, full_uuid(value), UUID::LENGTH_OF_LONG_UUID);
+        } else {
+            memcpy(long_uuid, _bases.get(kind), UUID::LENGTH_OF_LONG_UUID);
+            long_uuid[SHORT_PART_OFFSET] = value;
+            long_uuid[SHORT_PART_OFFSET + 1] = value >> 8;
+        }
+        characteristic.setupLongUUID(long_uuid, UUID::LSB);
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    size_t base_count() const
+    {
+        return _bases.size();
+    }
+
+    /** Number of 128-bit UUIDs stored in full */
+    size_t full_uuid_count() const
+    {
+        return _full_uuids;
+    }
+
+    /** Bytes used by the characteristics and UUIDs stored */
+    size_t used_bytes() const
+    {
+        return _size * RECORD_SIZE + (_full_uuids + _bases.size()) * UUID::LENGTH_OF_LONG_UUID;
+    }
+
+private:
+    /* kinds of UUID of a record other than the index of a base */
+    static const uint8_t SHORT_UUID = UINT8_MAX - 1;
+    static const uint8_t FULL_UUID = UuidBaseTable<BaseCapacity>::NOT_FOUND;
+
+    static_assert(BaseCapacity < SHORT_UUID, "base indexes must not collide with the UUID kinds");
+
+    /* position of the 16-bit part in a 128-bit UUID stored in little endian */
+    static const size_t SHORT_PART_OFFSET = 12;
+
+    /* a record and the UUIDs stored in full, on top of the ones stored, still fit */
+    bool room_left(size_t extra) const
+    {
+        return (_size + 1) * RECORD_SIZE + _full_uuids * UUID::LENGTH_OF_LONG_UUID + extra <= sizeof(_storage);
+    }
+
+    uint8_t *full_uuid(size_t index)
+    {
+        return _storage + sizeof(_storage) - (index + 1) * UUID::LENGTH_OF_LONG_UUID;
+    }
+
+    const uint8_t *full_uuid(size_t index) const
+    {
+        return _storage + sizeof(_storage) - (index + 1) * UUID::LENGTH_OF_LONG_UUID;
+    }
+
+    static void write_u16(uint8_t *data, uint16_t value)
+    {
+        data[0] = value;
+        data[1] = value >> 8;
+    }
+
+    static uint16_t read_u16(const uint8_t *data)
+    {
+        return data[0] | (data[1] << 8);
+    }
+
+    static uint8_t pack(const Properties_t &properties)
+    {
+        return (properties.broadcast() << 0) |
+            (properties.read() << 1) |
+            (properties.writeWoResp() << 2) |
+            (properties.write() << 3) |
+            (properties.notify() << 4) |
+            (properties.indicate() << 5) |
+            (properties.authSignedWrite() << 6);
+    }
+
+    static Properties_t unpack(uint8_t value)
+    {
+        Properties_t properties;
+        properties._broadcast = (value >> 0) & 1;
+        properties._read = (value >> 1) & 1;
+        properties._writeWoResp = (value >> 2) & 1;
+        properties._write = (value >> 3) & 1;
+        properties._notify = (value >> 4) & 1;
+        properties._indicate = (value >> 5) & 1;
+        properties._authSignedWrite = (value >> 6) & 1;
+        return properties;
+    }
+
+    size_t _size = 0;
+    /* 128-bit UUIDs stored in full at the end of the storage */
+    size_t _full_uuids = 0;
+    UuidBaseTable<BaseCapacity> _bases;
+    uint8_t _storage[Capacity * RECORD_SIZE];
+};
+
+#endif // GATT_CHARACTERISTIC_TABLE_H_
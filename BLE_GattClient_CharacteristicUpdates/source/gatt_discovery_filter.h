@@ -0,0 +1,174 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GATT_DISCOVERY_FILTER_H_
+#define GATT_DISCOVERY_FILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ble/BLE.h"
+
+/**
+ * Set of characteristics wanted by a client, identified by the UUID of their
+ * service and their own UUID.
+ *
+ * The filter drives a discovery made of one service discovery by UUID per
+ * distinct service wanted: next_service() gives the service to discover next
+ * and match() tells if a characteristic discovered in it is wanted. Services
+ * whose characteristics were all found are skipped, and the discovery can
+ * stop as soon as complete() returns true.
+ *
+ * If a server has several instances of a service, characteristics are
+ * matched in the first instance only.
+ *
+ * @tparam Capacity Maximum number of characteristics wanted.
+ */
+template<size_t Capacity>
+class GattDiscoveryFilter {
+public:
+    /**
+     * Add a characteristic to the set.
+     *
+     * @return false if the set is full.
+     */
+    bool add(const UUID &service, const UUID &characteristic)
+    {
+        if (_size == Capacity) {
+            return false;
+        }
+
+        _entries[_size].service = service;
+        _entries[_size].characteristic = characteristic;
+        _size++;
+        reset();
+        return true;
+    }
+
+    /** Restart the matching for a new discovery */
+    void reset()
+    {
+        for (size_t i = 0; i < _size; ++i) {
+            _entries[i].queried = false;
+            _entries[i].found = false;
+        }
+        _found = 0;
+        _services = 0;
+        _current = nullptr;
+    }
+
+    /** Check if a service still has to be discovered */
+    bool has_next_service() const
+    {
+        return next_entry() < _size;
+    }
+
+    /**
+     * Get the next service to discover.
+     *
+     * @return false if no service has characteristics left to find.
+     */
+    bool next_service(UUID &service)
+    {
+        size_t next = next_entry();
+        if (next == _size) {
+            return false;
+        }
+
+        for (size_t i = 0; i < _size; ++i) {
+            if (_entries[i].service == _entries[next].service) {
+                _entries[i].queried = true;
+            }
+        }
+
+        _current = &_entries[next].service;
+        _services++;
+        service = _entries[next].service;
+        return true;
+    }
+
+    /**
+     * Match a characteristic discovered in the service being discovered.
+     *
+     * @return true if the characteristic is wanted and wasn't found before.
+     */
+    bool match(const UUID &characteristic)
+    {
+        if (!_current) {
+            return false;
+        }
+
+        for (size_t i = 0; i < _size; ++i) {
+            entry_t &entry = _entries[i];
+            if (!entry.found && entry.service == *_current && entry.characteristic == characteristic) {
+                entry.found = true;
+                _found++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** All the characteristics wanted were found */
+    bool complete() const
+    {
+        return _found == _size;
+    }
+
+    /** Number of characteristics wanted */
+    size_t size() const
+    {
+        return _size;
+    }
+
+    /** Number of characteristics found */
+    size_t found() const
+    {
+        return _found;
+    }
+
+    /** Number of services discovered */
+    size_t services() const
+    {
+        return _services;
+    }
+
+private:
+    struct entry_t {
+        UUID service;
+        UUID characteristic;
+        bool queried;
+        bool found;
+    };
+
+    /* index of the first entry of a service not discovered yet, _size if none */
+    size_t next_entry() const
+    {
+        size_t i = 0;
+        while (i < _size && (_entries[i].queried || _entries[i].found)) {
+            ++i;
+        }
+        return i;
+    }
+
+    size_t _size = 0;
+    size_t _found = 0;
+    size_t _services = 0;
+    const UUID *_current = nullptr;
+    entry_t _entries[Capacity];
+};
+
+#endif // GATT_DISCOVERY_FILTER_H_
@@ -0,0 +1,313 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GATT_LONG_READER_H_
+#define GATT_LONG_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ble/BLE.h"
+#include "ble/GattClient.h"
+
+/**
+ * Read attribute values longer than a single ATT response.
+ *
+ * The value is read in chunks: a Read at offset 0 then Read Blob requests at
+ * the offset following the last chunk, as long as responses fill the ATT_MTU
+ * (ATT_MTU - 1 bytes). Each chunk is handed as it arrives either to a sink or
+ * copied at its offset in the buffer of the caller.
+ *
+ * The Cordio GattClient already reads long values with Read Blob and hands
+ * the whole value, reassembled in its own buffer, in a single response. On
+ * this stack the first response is longer than ATT_MTU - 1 bytes and the read
+ * ends there: the value is copied once from the buffer of the stack and no
+ * chunk is requested. The chunked reads only run on stacks which return the
+ * raw response.
+ *
+ * Responses must be forwarded to on_data_read().
+ */
+class GattLongReader {
+public:
+    /* longest value of an attribute */
+    static const size_t MAX_ATTRIBUTE_LENGTH = 512;
+
+    /**
+     * Receive a chunk of the value.
+     *
+     * Return false to stop the read.
+     */
+    typedef mbed::Callback<bool(uint16_t offset, const uint8_t *data, uint16_t length)> sink_t;
+
+    /** Called with the status of the read and the length of the value read */
+    typedef mbed::Callback<void(ble_error_t status, size_t length)> completion_t;
+
+    struct stats_t {
+        /* Read and Read Blob requests sent */
+        uint32_t requests;
+        /* requests refused by the stack and retried */
+        uint32_t retries;
+    };
+
+    /**
+     * Start reading a value into a buffer.
+     *
+     * The read stops once the buffer is full.
+     *
+     * @param[in] client GattClient of the connection.
+     * @param[in] connection_handle Connection to the server.
+     * @param[in] handle Handle of the attribute to read.
+     * @param[in] att_mtu ATT_MTU of the connection.
+     * @param[in] buffer Buffer receiving the value.
+     * @param[in] size Size of the buffer.
+     * @param[in] on_complete Called once the read ends.
+     *
+     * @return BLE_ERROR_NONE if the read was started.
+     */
+    ble_error_t read(
+        GattClient *client,
+        ble::connection_handle_t connection_handle,
+        GattAttribute::Handle_t handle,
+        uint16_t att_mtu,
+        uint8_t *buffer,
+        size_t size,
+        completion_t on_complete
+    )
+    {
+        if (!buffer || !size) {
+            return BLE_ERROR_INVALID_PARAM;
+        }
+
+        _buffer = buffer;
+        _size = size;
+        return start(client, connection_handle, handle, att_mtu, nullptr, on_complete);
+    }
+
+    /**
+     * Start reading a value into a sink.
+     *
+     * @param[in] client GattClient of the connection.
+     * @param[in] connection_handle Connection to the server.
+     * @param[in] handle Handle of the attribute to read.
+     * @param[in] att_mtu ATT_MTU of the connection.
+     * @param[in] sink Receive the chunks of the value.
+     * @param[in] on_complete Called once the read ends.
+     *
+     * @return BLE_ERROR_NONE if the read was started.
+     */
+    ble_error_t read(
+        GattClient *client,
+        ble::connection_handle_t connection_handle,
+        GattAttribute::Handle_t handle,
+        uint16_t att_mtu,
+        sink_t sink,
+        completion_t on_complete
+    )
+    {
+        if (!sink) {
+            return BLE_ERROR_INVALID_PARAM;
+        }
+
+        _buffer = nullptr;
+        _size = MAX_ATTRIBUTE_LENGTH;
+        return start(client, connection_handle, handle, att_mtu, sink, on_complete);
+    }
+
+    /**
+     * Handle a read response.
+     *
+     * @return true if the response belongs to the read in progress.
+     */
+    bool on_data_read(const GattReadCallbackParams *event)
+    {
+        if (!_active ||
+            !_in_flight ||
+            event->connHandle != _connection_handle ||
+            event->handle != _handle
+        ) {
+            return false;
+        }
+
+        _in_flight = false;
+
+        if (event->status) {
+            // reading past the end of a value whose length is a multiple of
+            // the chunk size isn't an error, the value is complete
+            if (_offset && event->error_code == ATT_ERROR_INVALID_OFFSET) {
+                complete(BLE_ERROR_NONE);
+            } else {
+                complete(event->status);
+            }
+            return true;
+        }
+
+        uint16_t length = event->len;
+        if (length > _size - _offset) {
+            length = _size - _offset;
+        }
+
+        if (_buffer) {
+            memcpy(_buffer + _offset, event->data, length);
+        } else if (!_sink(_offset, event->data, length)) {
+            _offset += length;
+            complete(BLE_ERROR_NONE);
+            return true;
+        }
+        _offset += length;
+
+        // a response shorter than the ATT_MTU is the last chunk, a longer one
+        // is the whole value reassembled by the stack
+        if (event->len != _att_mtu - 1 || _offset == _size) {
+            complete(BLE_ERROR_NONE);
+            return true;
+        }
+
+        issue();
+        return true;
+    }
+
+    /**
+     * Issue the request the stack refused earlier.
+     *
+     * @return true if the request is still waiting to be issued.
+     */
+    bool retry()
+    {
+        if (stalled()) {
+            issue();
+        }
+        return stalled();
+    }
+
+    /**
+     * Abandon the read in progress, responses to the requests already issued
+     * are ignored and the completion callback isn't called.
+     */
+    void cancel()
+    {
+        _active = false;
+    }
+
+    /** A request is waiting to be issued */
+    bool stalled() const
+    {
+        return _active && !_in_flight;
+    }
+
+    bool active() const
+    {
+        return _active;
+    }
+
+    /** Bytes of the value read so far */
+    size_t length() const
+    {
+        return _offset;
+    }
+
+    const stats_t &stats() const
+    {
+        return _stats;
+    }
+
+private:
+    static const uint8_t ATT_ERROR_INVALID_OFFSET = 0x07;
+
+    ble_error_t start(
+        GattClient *client,
+        ble::connection_handle_t connection_handle,
+        GattAttribute::Handle_t handle,
+        uint16_t att_mtu,
+        sink_t sink,
+        completion_t on_complete
+    )
+    {
+        if (_active) {
+            return BLE_ERROR_INVALID_STATE;
+        }
+
+        _client = client;
+        _connection_handle = connection_handle;
+        _handle = handle;
+        _att_mtu = att_mtu;
+        _sink = sink;
+        _on_complete = on_complete;
+        _offset = 0;
+        _stats = stats_t();
+        _active = true;
+        _in_flight = false;
+
+        ble_error_t error = _client->read(_connection_handle, _handle, 0);
+        if (is_busy(error)) {
+            _stats.retries++;
+            return BLE_ERROR_NONE;
+        } else if (error) {
+            _active = false;
+            return error;
+        }
+
+        _in_flight = true;
+        _stats.requests++;
+        return BLE_ERROR_NONE;
+    }
+
+    void issue()
+    {
+        ble_error_t error = _client->read(_connection_handle, _handle, _offset);
+        if (is_busy(error)) {
+            _stats.retries++;
+            return;
+        } else if (error) {
+            complete(error);
+            return;
+        }
+
+        _in_flight = true;
+        _stats.requests++;
+    }
+
+    /* Cordio refuses a request while another procedure runs on the connection
+     * with BLE_ERROR_INVALID_STATE */
+    static bool is_busy(ble_error_t error)
+    {
+        return error == BLE_STACK_BUSY || error == BLE_ERROR_INVALID_STATE;
+    }
+
+    void complete(ble_error_t status)
+    {
+        _active = false;
+        if (_on_complete) {
+            _on_complete(status, _offset);
+        }
+    }
+
+    GattClient *_client = nullptr;
+    ble::connection_handle_t _connection_handle = 0;
+    GattAttribute::Handle_t _handle = 0;
+    uint16_t _att_mtu = 0;
+    sink_t _sink;
+    completion_t _on_complete;
+    bool _active = false;
+    bool _in_flight = false;
+    stats_t _stats = stats_t();
+
+    uint8_t *_buffer = nullptr;
+    size_t _size = 0;
+    size_t _offset = 0;
+};
+
+#endif // GATT_LONG_READER_H_
@@ -0,0 +1,126 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HANDLE_DISPATCH_TABLE_H_
+#define HANDLE_DISPATCH_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Map attribute handles to the target events on them are dispatched to.
+ *
+ * Handles are kept sorted in an array and looked up with a binary search.
+ * Entries are usually added in handle order, as attributes are discovered,
+ * so inserting them costs nothing more than the comparison with the last
+ * one.
+ *
+ * Nothing here depends on Mbed OS.
+ *
+ * @tparam Capacity Maximum number of handles.
+ * @tparam Target Type of the value associated with a handle.
+ */
+template<size_t Capacity, typename Target>
+class HandleDispatchTable {
+public:
+    /** Remove all the entries */
+    void clear()
+    {
+        _size = 0;
+    }
+
+    /**
+     * Associate a handle with a target.
+     *
+     * @return false if the table is full or the handle already present.
+     */
+    bool add(uint16_t handle, const Target &target)
+    {
+        if (_size == Capacity || find(handle)) {
+            return false;
+        }
+
+        /* insertion sort, entries added in order don't move anything */
+        size_t i = _size;
+        while (i && _handles[i - 1] > handle) {
+            _handles[i] = _handles[i - 1];
+            _targets[i] = _targets[i - 1];
+            --i;
+        }
+
+        _handles[i] = handle;
+        _targets[i] = target;
+        _size++;
+        return true;
+    }
+
+    /**
+     * Remove the entry of a handle.
+     *
+     * @return false if the handle isn't in the table.
+     */
+    bool remove(uint16_t handle)
+    {
+        const Target *target = find(handle);
+        if (!target) {
+            return false;
+        }
+
+        for (size_t i = target - _targets + 1; i < _size; ++i) {
+            _handles[i - 1] = _handles[i];
+            _targets[i - 1] = _targets[i];
+        }
+        _size--;
+        return true;
+    }
+
+    /**
+     * Find the target of a handle.
+     *
+     * @return nullptr if the handle isn't in the table.
+     */
+    const Target *find(uint16_t handle) const
+    {
+        size_t low = 0;
+        size_t high = _size;
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (_handles[mid] < handle) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+
+        if (low < _size && _handles[low] == handle) {
+            return &_targets[low];
+        }
+        return nullptr;
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+private:
+    size_t _size = 0;
+    /* handles and targets are split so the search only touches the handles */
+    uint16_t _handles[Capacity];
+    Target _targets[Capacity];
+};
+
+#endif // HANDLE_DISPATCH_TABLE_H_
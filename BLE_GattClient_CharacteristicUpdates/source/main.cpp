@@ -16,12 +16,55 @@
  */
 
 #include "events/EventQueue.h"
+#include "drivers/Timer.h"
 #include "platform/NonCopyable.h"
+#include "platform/mbed_stats.h"
 
 #include "ble/GattClient.h"
 
 #include "gatt_client_process.h"
 #include "mbed-trace/mbed_trace.h"
+#include "gatt_attribute_cache.h"
+#include "gatt_long_reader.h"
+#include "notification_ring.h"
+#include "handle_dispatch_table.h"
+#include "gatt_characteristic_table.h"
+#include "gatt_discovery_filter.h"
+#include "throughput_benchmark.h"
+
+using namespace std::chrono;
+using namespace std::literals::chrono_literals;
+
+/* delay before retrying operations refused by a busy stack when nothing is in flight */
+static const milliseconds BUSY_RETRY_DELAY = 10ms;
+
+#if MBED_CONF_APP_DISPATCH_BENCHMARK
+/* lookups timed for each size of the dispatch table */
+static const size_t DISPATCH_BENCHMARK_LOOKUPS = 100000;
+static const size_t DISPATCH_BENCHMARK_SIZES[] = { 10, 100, 1000 };
+#endif // MBED_CONF_APP_DISPATCH_BENCHMARK
+
+#if MBED_CONF_APP_THROUGHPUT_BENCHMARK && MBED_CONF_APP_MAX_LINKS > 1
+#error "The throughput benchmark runs on a single link, set max-links to 1"
+#endif
+
+#if MBED_CONF_APP_FILTERED_DISCOVERY
+/* characteristics looked for by the filtered discovery: the clock service of BLE_GattServer_CharacteristicUpdates */
+static const char CLOCK_SERVICE_UUID[] = "51311102-030e-485f-b122-f8f381aa84ed";
+static const struct {
+    const char *service;
+    const char *characteristic;
+} WANTED_CHARACTERISTICS[] = {
+    { CLOCK_SERVICE_UUID, "485f4145-52b9-4644-af1f-7a6b9322490f" }, // hour
+    { CLOCK_SERVICE_UUID, "0a924ca7-87cd-4699-a3bd-abdcd9cf126a" }, // minute
+    { CLOCK_SERVICE_UUID, "8dd6a1b7-bc75-4741-8a26-264af75807de" }, // second
+};
+#endif // MBED_CONF_APP_FILTERED_DISCOVERY
+
+#if MBED_CONF_APP_NOTIFICATION_RING
+/* period of the report of the notifications ingested */
+static const milliseconds NOTIFICATION_REPORT_PERIOD = 5000ms;
+#endif // MBED_CONF_APP_NOTIFICATION_RING
 
 /**
  * Handle discovery of the GATT server.
@@ -41,6 +84,55 @@ class GattClientDemo : private mbed::NonCopyable<GattClientDemo>, public GattCli
     typedef CharacteristicDescriptorDiscovery::TerminationCallbackParams_t TerminationCallbackParams_t;
     typedef DiscoveredCharacteristic::Properties_t Properties_t;
 
+    static const size_t MAX_CHARACTERISTICS = MBED_CONF_APP_MAX_CHARACTERISTICS;
+    static const size_t NO_CHARACTERISTIC = SIZE_MAX;
+    static const uint16_t DEFAULT_ATT_MTU = 23;
+
+    /* attribute of a characteristic an event is received on */
+    enum attribute_t : uint8_t {
+        ATTRIBUTE_VALUE,
+        ATTRIBUTE_CCCD
+    };
+
+    struct route_t {
+        uint16_t characteristic;
+        attribute_t attribute;
+    };
+
+    /* print the value of a characteristic, chosen from its UUID */
+    typedef void (Self::*value_printer_t)(const uint8_t *data, size_t length);
+
+    /* value handle and CCCD handle of each characteristic */
+    typedef HandleDispatchTable<2 * MAX_CHARACTERISTICS, route_t> DispatchTable;
+
+#if MBED_CONF_APP_COMPACT_CHARACTERISTICS
+    typedef GattCharacteristicTable<MAX_CHARACTERISTICS, MBED_CONF_APP_UUID_TABLE_SIZE> CharacteristicTable;
+#endif // MBED_CONF_APP_COMPACT_CHARACTERISTICS
+
+#if MBED_CONF_APP_NOTIFICATION_RING
+    static const size_t NOTIFICATION_PAYLOAD = MBED_CONF_APP_NOTIFICATION_MAX_PAYLOAD;
+    typedef notification_ring::Ring<MBED_CONF_APP_NOTIFICATION_RING_SIZE, NOTIFICATION_PAYLOAD> NotificationRing;
+    typedef notification_ring::entry_t<NOTIFICATION_PAYLOAD> notification_t;
+#endif // MBED_CONF_APP_NOTIFICATION_RING
+
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+    typedef GattAttributeCache<MBED_CONF_APP_ATTRIBUTE_CACHE_PEERS, MAX_CHARACTERISTICS> AttributeCache;
+
+    /* characteristics of the GATT service used to validate the cache */
+    static const uint16_t SERVICE_CHANGED_UUID = 0x2A05;
+    static const uint16_t DATABASE_HASH_UUID = 0x2B2A;
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
+
+#if MBED_CONF_APP_FILTERED_DISCOVERY
+    /* wanted characteristics, including the ones added by other options */
+    static const size_t MAX_WANTED_CHARACTERISTICS = 8;
+    static const uint16_t GENERIC_ATTRIBUTE_SERVICE_UUID = 0x1801;
+#endif // MBED_CONF_APP_FILTERED_DISCOVERY
+
+    /* characteristics whose value is printed decoded */
+    static const uint16_t BATTERY_LEVEL_UUID = 0x2A19;
+    static const uint16_t HEART_RATE_MEASUREMENT_UUID = 0x2A37;
+
 public:
 
     /**
@@ -48,11 +140,44 @@ public:
      *
      * The function start() shall be called to initiate the discovery process.
      */
-    GattClientDemo() { }
+    GattClientDemo()
+    {
+#if MBED_CONF_APP_FILTERED_DISCOVERY
+        for (const auto &wanted : WANTED_CHARACTERISTICS) {
+            _discovery_filter.add(UUID(wanted.service), UUID(wanted.characteristic));
+        }
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+        // the cache is validated with the Database Hash and invalidated by
+        // Service Changed indications
+        _discovery_filter.add(UUID(GENERIC_ATTRIBUTE_SERVICE_UUID), UUID(DATABASE_HASH_UUID));
+        _discovery_filter.add(UUID(GENERIC_ATTRIBUTE_SERVICE_UUID), UUID(SERVICE_CHANGED_UUID));
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
+#if MBED_CONF_APP_THROUGHPUT_BENCHMARK
+        _discovery_filter.add(UUID(throughput::SERVICE_UUID), UUID(throughput::DATA_UUID));
+        _discovery_filter.add(UUID(throughput::SERVICE_UUID), UUID(throughput::CONTROL_UUID));
+#endif // MBED_CONF_APP_THROUGHPUT_BENCHMARK
+#endif // MBED_CONF_APP_FILTERED_DISCOVERY
+    }
 
     ~GattClientDemo()
     {
         stop();
+
+        if (!_client) {
+            return;
+        }
+
+        // unregister event handlers
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+        _client->onDataRead().detach(as_cb(&Self::when_database_hash_read));
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
+#if MBED_CONF_APP_PIPELINED_PROCESSING
+        _client->onDataRead().detach(as_cb(&Self::when_pipelined_read));
+        _client->onDataWritten().detach(as_cb(&Self::when_pipelined_write));
+#else
+        _client->onDataWritten().detach(as_cb(&Self::when_descriptor_written));
+#endif // MBED_CONF_APP_PIPELINED_PROCESSING
+        _client->onHVX().detach(as_cb(&Self::when_characteristic_changed));
     }
 
     void start(BLE &ble, events::EventQueue &event_queue)
@@ -60,48 +185,117 @@ public:
         _ble = &ble;
         _event_queue = &event_queue;
         _client = &_ble->gattClient();
+
+        // setup the event handlers called during the process, they are
+        // registered once and used by all the connections
+#if MBED_CONF_APP_PIPELINED_PROCESSING
+        _client->onDataRead().add(as_cb(&Self::when_pipelined_read));
+        _client->onDataWritten().add(as_cb(&Self::when_pipelined_write));
+#else
+        _client->onDataWritten().add(as_cb(&Self::when_descriptor_written));
+#endif // MBED_CONF_APP_PIPELINED_PROCESSING
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+        _client->onDataRead().add(as_cb(&Self::when_database_hash_read));
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
+#if MBED_CONF_APP_LONG_READS
+        _client->onDataRead().add(as_cb(&Self::when_long_read));
+#endif // MBED_CONF_APP_LONG_READS
+#if MBED_CONF_APP_THROUGHPUT_BENCHMARK
+        _client->onDataWritten().add(as_cb(&Self::when_throughput_control_written));
+
+        // the benchmark follows the changes of the link along with the process
+        _gap_event_handlers.addEventHandler(_process_gap_event_handler);
+        _gap_event_handlers.addEventHandler(&_throughput_benchmark);
+        _ble->gap().setEventHandler(&_gap_event_handlers);
+#endif // MBED_CONF_APP_THROUGHPUT_BENCHMARK
+        _client->onHVX().add(as_cb(&Self::when_characteristic_changed));
+
+#if MBED_CONF_APP_MAX_LINKS == 1
+        // register as a handler for GattClient events, with several links
+        // they are dispatched by GattClientLinks
+        _client->setEventHandler(this);
+#endif // MBED_CONF_APP_MAX_LINKS == 1
+
+#if MBED_CONF_APP_DISPATCH_BENCHMARK
+        run_dispatch_benchmark();
+#endif // MBED_CONF_APP_DISPATCH_BENCHMARK
+
+#if MBED_CONF_APP_NOTIFICATION_RING
+        _ingestion_clock.start();
+        _event_queue->call_every(
+            NOTIFICATION_REPORT_PERIOD,
+            mbed::callback(this, &Self::print_notification_stats)
+        );
+#endif // MBED_CONF_APP_NOTIFICATION_RING
+    }
+
+#if MBED_CONF_APP_MAX_LINKS > 1
+    /**
+     * Set the function called once all characteristics of the link are
+     * processed.
+     */
+    void on_subscribed(mbed::Callback<void(ble::connection_handle_t)> callback)
+    {
+        _on_subscribed = callback;
+    }
+
+    /**
+     * Handle the end of the service discovery of the link, dispatched by
+     * GattClientLinks.
+     */
+    void end_service_discovery(ble::connection_handle_t connection_handle)
+    {
+        when_service_discovery_ends(connection_handle);
+    }
+#endif // MBED_CONF_APP_MAX_LINKS > 1
+
+#if MBED_CONF_APP_THROUGHPUT_BENCHMARK
+    /**
+     * Set the GAP event handler of the process, GAP events are dispatched to
+     * it and to the benchmark.
+     *
+     * @note Must be called before start().
+     */
+    void set_process_gap_event_handler(ble::Gap::EventHandler *handler)
+    {
+        _process_gap_event_handler = handler;
     }
+#endif // MBED_CONF_APP_THROUGHPUT_BENCHMARK
 
     /**
      * Start the discovery process.
      *
-     * @param[in] client The GattClient instance which will discover the distant
-     * GATT server.
-     * @param[in] connection_handle Reference of the connection to the GATT
-     * server which will be discovered.
+     * If the layout of the peer's GATT server is cached the discovery is
+     * skipped provided the Database Hash of the server didn't change.
+     *
+     * @param[in] ble_interface The BLE instance of the connection.
+     * @param[in] event_queue The event queue used by the process.
+     * @param[in] event Connection event of the GATT server which will be
+     * discovered.
      */
     void start_discovery(BLE &ble_interface, events::EventQueue &event_queue, const ble::ConnectionCompleteEvent &event)
     {
         _connection_handle = event.getConnectionHandle();
+        _att_mtu = DEFAULT_ATT_MTU;
 
-        // setup the event handlers called during the process
-        _client->onDataWritten().add(as_cb(&Self::when_descriptor_written));
-        _client->onHVX().add(as_cb(&Self::when_characteristic_changed));
+        // this might not result in a new value but if it does we will be informed through
+        // an call in the event handler registered
+        _client->negotiateAttMtu(_connection_handle);
 
-        // The discovery process will invoke when_service_discovered when a
-        // service is discovered, when_characteristic_discovered when a
-        // characteristic is discovered and when_service_discovery_ends once the
-        // discovery process has ended.
-        _client->onServiceDiscoveryTermination(as_cb(&Self::when_service_discovery_ends));
-        ble_error_t error = _client->launchServiceDiscovery(
-            _connection_handle,
-            as_cb(&Self::when_service_discovered),
-            as_cb(&Self::when_characteristic_discovered)
-        );
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+        _peer_address_type = event.getPeerAddressType();
+        _peer_address = event.getPeerAddress();
+        _cache_hot = false;
 
-        if (error) {
-            printf("Error %u returned by _client->launchServiceDiscovery.\r\n", error);
+        _connection_timer.reset();
+        _connection_timer.start();
+
+        if (validate_cache()) {
             return;
         }
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
 
-        // register as a handler for GattClient events
-        _client->setEventHandler(this);
-
-        // this might not result in a new value but if it does we will be informed through
-        // an call in the event handler we just registered
-        _client->negotiateAttMtu(_connection_handle);
-
-        printf("Client process started: initiate service discovery.\r\n");
+        launch_discovery();
     }
 
     /**
@@ -113,18 +307,30 @@ public:
             return;
         }
 
-        // unregister event handlers
-        _client->onDataWritten().detach(as_cb(&Self::when_descriptor_written));
-        _client->onHVX().detach(as_cb(&Self::when_characteristic_changed));
+        // the event handlers stay registered for the next connection
+#if MBED_CONF_APP_MAX_LINKS == 1
         _client->onServiceDiscoveryTermination(nullptr);
+#endif // MBED_CONF_APP_MAX_LINKS == 1
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+        _validating_cache = false;
+        _pass_cancelled = false;
+        _event_queue->cancel(_relaunch_event);
+        _relaunch_event = 0;
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
+#if MBED_CONF_APP_PIPELINED_PROCESSING
+        _event_queue->cancel(_pipeline_retry_event);
+        _pipeline_retry_event = 0;
+#endif // MBED_CONF_APP_PIPELINED_PROCESSING
+#if MBED_CONF_APP_THROUGHPUT_BENCHMARK
+        _throughput_benchmark.stop();
+#endif // MBED_CONF_APP_THROUGHPUT_BENCHMARK
 
         // remove discovered characteristics
         clear_characteristics();
 
         // clean up the instance
         _connection_handle = 0;
-        _characteristics = nullptr;
-        _it = nullptr;
+        _it = NO_CHARACTERISTIC;
         _descriptor_handle = 0;
 
         printf("Client process stopped.\r\n");
@@ -139,6 +345,10 @@ private:
         uint16_t attMtuSize
     )
     {
+        if (connectionHandle == _connection_handle) {
+            _att_mtu = attMtuSize;
+        }
+
         printf(
             "ATT_MTU changed on the connection %d to a new value of %d.\r\n",
             connectionHandle,
@@ -151,6 +361,115 @@ private:
 ////////////////////////////////////////////////////////////////////////////////
 // Service and characteristic discovery process.
 
+    /**
+     * Discover the services and characteristics of the GATT server.
+     */
+    ble_error_t launch_discovery()
+    {
+        clear_characteristics();
+
+        _discovery_timer.reset();
+        _discovery_timer.start();
+
+        // The discovery process will invoke when_service_discovered when a
+        // service is discovered, when_characteristic_discovered when a
+        // characteristic is discovered and when_service_discovery_ends once the
+        // discovery process has ended.
+#if MBED_CONF_APP_MAX_LINKS == 1
+        _client->onServiceDiscoveryTermination(as_cb(&Self::when_service_discovery_ends));
+#endif // MBED_CONF_APP_MAX_LINKS == 1
+#if MBED_CONF_APP_FILTERED_DISCOVERY
+        _discovery_filter.reset();
+        ble_error_t error = launch_wanted_service_discovery();
+        if (error) {
+            printf("Error %u returned by _client->launchServiceDiscovery.\r\n", error);
+            return error;
+        }
+
+        printf("Client process started: discover the wanted services.\r\n");
+#else
+        ble_error_t error = _client->launchServiceDiscovery(
+            _connection_handle,
+            as_cb(&Self::when_service_discovered),
+            as_cb(&Self::when_characteristic_discovered)
+        );
+
+        if (error) {
+            printf("Error %u returned by _client->launchServiceDiscovery.\r\n", error);
+            return error;
+        }
+
+        printf("Client process started: initiate service discovery.\r\n");
+#endif // MBED_CONF_APP_FILTERED_DISCOVERY
+        return BLE_ERROR_NONE;
+    }
+
+    /**
+     * Check if the processing pass was cancelled by a Service Changed
+     * indication.
+     *
+     * Callbacks and deferred steps of a cancelled pass return early instead
+     * of working on the characteristics being discovered again. Each one
+     * marks a procedure ending, the discovery is relaunched once the stack is
+     * free.
+     */
+    bool pass_cancelled()
+    {
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+        if (_pass_cancelled) {
+            schedule_relaunch(0ms);
+            return true;
+        }
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
+        return false;
+    }
+
+#if MBED_CONF_APP_FILTERED_DISCOVERY
+    /**
+     * Discover the next service with wanted characteristics left to find.
+     *
+     * The stack discovers the service with Discover Primary Service by UUID
+     * then the characteristics within its handle range only.
+     */
+    void discover_next_wanted_service()
+    {
+        if (pass_cancelled()) {
+            return;
+        }
+
+        ble_error_t error = launch_wanted_service_discovery();
+        if (error) {
+            printf("Error %u returned by _client->launchServiceDiscovery.\r\n", error);
+            stop();
+        }
+    }
+
+    ble_error_t launch_wanted_service_discovery()
+    {
+        UUID service;
+        if (!_discovery_filter.next_service(service)) {
+            return BLE_ERROR_NONE;
+        }
+
+        return _client->launchServiceDiscovery(
+            _connection_handle,
+            as_cb(&Self::when_service_discovered),
+            as_cb(&Self::when_characteristic_discovered),
+            service
+        );
+    }
+
+    /**
+     * Stop the discovery once all wanted characteristics are found.
+     */
+    void terminate_filtered_discovery()
+    {
+        if (_client->isServiceDiscoveryActive()) {
+            _client->terminateServiceDiscovery();
+        }
+    }
+#endif // MBED_CONF_APP_FILTERED_DISCOVERY
+
     /**
      * Handle services discovered.
      *
@@ -179,6 +498,10 @@ private:
      */
     void when_characteristic_discovered(const DiscoveredCharacteristic *discovered_characteristic)
     {
+        if (pass_cancelled()) {
+            return;
+        }
+
         // print characteristics properties
         printf("\tCharacteristic discovered: uuid = ");
         print_uuid(discovered_characteristic->getUUID());
@@ -191,14 +514,46 @@ private:
             discovered_characteristic->getLastHandle()
         );
 
+#if MBED_CONF_APP_FILTERED_DISCOVERY
+        if (!_discovery_filter.match(discovered_characteristic->getUUID())) {
+            return;
+        }
+#endif // MBED_CONF_APP_FILTERED_DISCOVERY
+
         // add the characteristic into the list of discovered characteristics
         bool success = add_characteristic(discovered_characteristic);
         if (!success) {
-            printf("Error: memory allocation failure while adding the discovered characteristic.\r\n");
+#if MBED_CONF_APP_COMPACT_CHARACTERISTICS
+            printf(
+                "Error: no room left for characteristic %u, %u UUIDs stored in full, "
+                "increase max-characteristics or uuid-table-size.\r\n",
+                _characteristic_count, _characteristic_table.full_uuid_count()
+            );
+#else
+            printf(
+                "Error: more than %u characteristics discovered, increase max-characteristics.\r\n",
+                MAX_CHARACTERISTICS
+            );
+#endif // MBED_CONF_APP_COMPACT_CHARACTERISTICS
             _client->terminateServiceDiscovery();
             stop();
             return;
         }
+
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+        track_gatt_service_characteristic(*discovered_characteristic);
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
+
+#if MBED_CONF_APP_FILTERED_DISCOVERY && MBED_CONF_APP_MAX_LINKS == 1
+        // the rest of the server isn't needed, the procedure is terminated
+        // once this callback has returned. Termination would stop the
+        // discovery of all the links, with several of them each procedure
+        // runs to its end.
+        if (_discovery_filter.complete()) {
+            printf("All wanted characteristics found, stop the discovery.\r\n");
+            _event_queue->call(mbed::callback(this, &Self::terminate_filtered_discovery));
+        }
+#endif // MBED_CONF_APP_FILTERED_DISCOVERY && MBED_CONF_APP_MAX_LINKS == 1
     }
 
     /**
@@ -211,21 +566,67 @@ private:
      */
     void when_service_discovery_ends(ble::connection_handle_t connection_handle)
     {
-        if (!_characteristics) {
+        if (pass_cancelled()) {
+            return;
+        }
+
+#if MBED_CONF_APP_FILTERED_DISCOVERY
+        if (!_discovery_filter.complete() && _discovery_filter.has_next_service()) {
+            // the procedure ending is still registered by the stack, start
+            // the next one once it is released
+            _event_queue->call(mbed::callback(this, &Self::discover_next_wanted_service));
+            return;
+        }
+#endif // MBED_CONF_APP_FILTERED_DISCOVERY
+
+        _discovery_timer.stop();
+        print_discovery_stats();
+
+        if (!_characteristic_count) {
             printf("No characteristics discovered, end of the process.\r\n");
             return;
         }
 
         printf("All services and characteristics discovered, process them.\r\n");
 
-        // reset iterator and start processing characteristics in order
-        _it = nullptr;
-        _event_queue->call(mbed::callback(this, &Self::process_next_characteristic));
+        process_characteristics();
     }
 
 ////////////////////////////////////////////////////////////////////////////////
 // Processing of characteristics based on their properties.
 
+    /**
+     * Start processing the characteristics, once discovered or restored from
+     * the cache.
+     */
+    void process_characteristics()
+    {
+        _processing_timer.reset();
+        _processing_timer.start();
+        _descriptor_discoveries = 0;
+        build_dispatch_table();
+
+#if MBED_CONF_APP_BULK_DESCRIPTOR_DISCOVERY
+        discover_all_descriptors();
+#else
+        subscribe_characteristics();
+#endif // MBED_CONF_APP_BULK_DESCRIPTOR_DISCOVERY
+    }
+
+    /**
+     * Read the characteristics not read yet and subscribe to them.
+     */
+    void subscribe_characteristics()
+    {
+#if MBED_CONF_APP_PIPELINED_PROCESSING
+        start_pipeline();
+#else
+        // reset iterator and start processing characteristics in order
+        _it = NO_CHARACTERISTIC;
+        _event_queue->call(mbed::callback(this, &Self::process_next_characteristic));
+#endif // MBED_CONF_APP_PIPELINED_PROCESSING
+    }
+
     /**
      * Process the characteristics discovered.
      *
@@ -236,42 +637,59 @@ private:
      */
     void process_next_characteristic(void)
     {
-        if (!_it) {
-            _it = _characteristics;
+        if (pass_cancelled()) {
+            return;
+        }
+
+        if (_it == NO_CHARACTERISTIC) {
+            _it = 0;
         } else {
-            _it = _it->next;
+            ++_it;
         }
 
-        while (_it) {
-            Properties_t properties = _it->value.getProperties();
+        while (_it < _characteristic_count) {
+            const DiscoveredCharacteristic &characteristic = get_characteristic(_it);
+            Properties_t properties = characteristic.getProperties();
 
             if (properties.read()) {
-                read_characteristic(_it->value);
+                read_characteristic(characteristic);
                 return;
             } else if(properties.notify() || properties.indicate()) {
-                discover_descriptors(_it->value);
+                subscribe_characteristic();
                 return;
             } else {
                 printf(
                     "Skip processing of characteristic %u\r\n",
-                    _it->value.getValueHandle()
+                    characteristic.getValueHandle()
                 );
-                _it = _it->next;
+                ++_it;
             }
         }
 
         printf("All characteristics discovered have been processed.\r\n");
+        when_processing_ends();
     }
 
     /**
      * Initate the read of the characteristic in input.
      *
      * The completion of the operation will happens in when_characteristic_read()
+     * or when_long_read_ends() if long reads are enabled.
      */
     void read_characteristic(const DiscoveredCharacteristic &characteristic)
     {
         printf("Initiating read at %u.\r\n", characteristic.getValueHandle());
+#if MBED_CONF_APP_LONG_READS
+        _long_read_timer.reset();
+        _long_read_timer.start();
+        ble_error_t error = _long_reader.read(
+            _client, _connection_handle, characteristic.getValueHandle(), _att_mtu,
+            _long_read_buffer, sizeof(_long_read_buffer),
+            mbed::callback(this, &Self::when_long_read_ends)
+        );
+#else
         ble_error_t error = characteristic.read(0, as_cb(&Self::when_characteristic_read));
+#endif // MBED_CONF_APP_LONG_READS
 
         if (error) {
             printf(
@@ -279,7 +697,12 @@ private:
                 characteristic.getValueHandle(), error
             );
             stop();
+            return;
         }
+
+#if MBED_CONF_APP_LONG_READS
+        retry_long_read_if_stalled();
+#endif // MBED_CONF_APP_LONG_READS
     }
 
     /**
@@ -292,21 +715,109 @@ private:
      */
     void when_characteristic_read(const GattReadCallbackParams *read_event)
     {
-        printf("\tCharacteristic value at %u equal to: ", read_event->handle);
-        for (size_t i = 0; i <  read_event->len; ++i) {
-            printf("0x%02X ", read_event->data[i]);
+        if (pass_cancelled()) {
+            return;
         }
+
+        printf("\tCharacteristic value at %u equal to: ", read_event->handle);
+        print_value(read_event->handle, read_event->data, read_event->len);
         printf(".\r\n");
 
-        Properties_t properties = _it->value.getProperties();
+        when_value_printed();
+    }
+
+    /**
+     * Continue the processing of the characteristic once its value is read.
+     */
+    void when_value_printed()
+    {
+        Properties_t properties = get_characteristic(_it).getProperties();
 
         if(properties.notify() || properties.indicate()) {
-            discover_descriptors(_it->value);
+            subscribe_characteristic();
         } else {
             process_next_characteristic();
         }
     }
 
+#if MBED_CONF_APP_LONG_READS
+    void when_long_read(const GattReadCallbackParams *read_event)
+    {
+        if (pass_cancelled()) {
+            return;
+        }
+
+        if (_long_reader.on_data_read(read_event)) {
+            retry_long_read_if_stalled();
+        }
+    }
+
+    /**
+     * The stack refused the next chunk, no response will trigger the next
+     * attempt.
+     */
+    void retry_long_read_if_stalled()
+    {
+        if (_long_reader.stalled()) {
+            _event_queue->call_in(BUSY_RETRY_DELAY, mbed::callback(this, &Self::retry_long_read));
+        }
+    }
+
+    void retry_long_read()
+    {
+        if (_long_reader.retry()) {
+            retry_long_read_if_stalled();
+        }
+    }
+
+    /**
+     * Print the value read in chunks and the throughput of the read.
+     */
+    void when_long_read_ends(ble_error_t status, size_t length)
+    {
+        _long_read_timer.stop();
+        GattAttribute::Handle_t handle = get_characteristic(_it).getValueHandle();
+
+        if (status) {
+            printf("Error: read at %u failed due to %u.\r\n", handle, status);
+            stop();
+            return;
+        }
+
+        printf("\tCharacteristic value at %u equal to: ", handle);
+        print_value(handle, _long_read_buffer, length);
+        printf(".\r\n");
+
+        uint64_t elapsed_us = duration_cast<microseconds>(_long_read_timer.elapsed_time()).count();
+        unsigned long throughput = elapsed_us ? (unsigned long) (length * 1000000ULL / elapsed_us) : 0;
+        printf(
+            "\t%u bytes read in %d ms with %lu requests (%lu retries): %lu bytes/s.\r\n",
+            length,
+            (int) (elapsed_us / 1000),
+            (unsigned long) _long_reader.stats().requests,
+            (unsigned long) _long_reader.stats().retries,
+            throughput
+        );
+
+        when_value_printed();
+    }
+#endif // MBED_CONF_APP_LONG_READS
+
+    /**
+     * Subscribe to the characteristic being processed.
+     *
+     * Its CCCD is discovered first unless its handle is already known.
+     */
+    void subscribe_characteristic()
+    {
+        if (_cccd_handles[_it]) {
+            _descriptor_handle = _cccd_handles[_it];
+            write_cccd();
+        } else {
+            discover_descriptors(get_characteristic(_it));
+        }
+    }
+
     /**
      * Initiate the discovery of the descriptors of the characteristic in input.
      *
@@ -329,7 +840,10 @@ private:
                 characteristic.getValueHandle(), error
             );
             stop();
+            return;
         }
+
+        ++_descriptor_discoveries;
     }
 
     /**
@@ -341,6 +855,10 @@ private:
      */
     void when_descriptor_discovered(const DiscoveryCallbackParams_t* event)
     {
+        if (pass_cancelled()) {
+            return;
+        }
+
         printf("\tDescriptor discovered at %u, UUID: ", event->descriptor.getAttributeHandle());
         print_uuid(event->descriptor.getUUID());
         printf(".\r\n");
@@ -359,6 +877,10 @@ private:
      */
     void when_descriptor_discovery_ends(const TerminationCallbackParams_t *event)
     {
+        if (pass_cancelled()) {
+            return;
+        }
+
         // shall never happen but happen with android devices ...
         // process the next charateristic
         if (!_descriptor_handle) {
@@ -367,7 +889,17 @@ private:
             return;
         }
 
-        Properties_t properties = _it->value.getProperties();
+        set_cccd_handle(_it, _descriptor_handle);
+        write_cccd();
+    }
+
+    /**
+     * Subscribe to server initiated events of the characteristic being
+     * processed by writing the value of its CCCD.
+     */
+    void write_cccd()
+    {
+        Properties_t properties = get_characteristic(_it).getProperties();
 
         uint16_t cccd_value =
             (properties.notify() << 0) | (properties.indicate() << 1);
@@ -394,6 +926,17 @@ private:
      */
     void when_descriptor_written(const GattWriteCallbackParams* event)
     {
+        if (event->connHandle != _connection_handle || pass_cancelled()) {
+            return;
+        }
+
+#if MBED_CONF_APP_THROUGHPUT_BENCHMARK
+        // writes of the benchmark are handled in when_throughput_control_written()
+        if (_throughput_benchmark.active()) {
+            return;
+        }
+#endif // MBED_CONF_APP_THROUGHPUT_BENCHMARK
+
         // should never happen
         if (!_descriptor_handle) {
             printf("\tError: received write response to unsolicited request.\r\n");
@@ -406,55 +949,932 @@ private:
         process_next_characteristic();
     }
 
+#if MBED_CONF_APP_BULK_DESCRIPTOR_DISCOVERY
+////////////////////////////////////////////////////////////////////////////////
+// Discovery of the descriptors of all the characteristics.
+
     /**
-     * Print the updated value of the characteristic.
-     *
-     * This function is called when the server emits a notification or an
-     * indication of a characteristic value the client has subscribed to.
+     * Find the CCCDs of all the characteristics with a single descriptor
+     * discovery per group of contiguous characteristics.
+     *
+     * The characteristics of a service are contiguous: the last handle of one
+     * precedes the declaration of the next. For each group the descriptor
+     * discovery of a synthetic characteristic spanning from the first
+     * characteristic which needs its CCCD to the end of the last one walks
+     * all the attributes in between. The CCCDs found are attributed to their
+     * owner from the declaration and last handles of the characteristics.
+     */
+    void discover_all_descriptors()
+    {
+        _bulk_next = 0;
+        _bulk_ranges = 0;
+        _bulk_attributes = 0;
+        _bulk_cccds = 0;
+
+        _bulk_timer.reset();
+        _bulk_timer.start();
+
+        discover_next_range();
+    }
+
+    void discover_next_range()
+    {
+        if (pass_cancelled()) {
+            return;
+        }
+
+        // first characteristic of the next range
+        while (_bulk_next < _characteristic_count && !needs_cccd(_bulk_next)) {
+            ++_bulk_next;
+        }
+
+        if (_bulk_next == _characteristic_count) {
+            when_all_descriptors_discovered();
+            return;
+        }
+
+        size_t first = _bulk_next;
+        size_t last = first;
+        for (size_t i = first + 1; i < _characteristic_count; ++i) {
+            if (get_characteristic(i).getDeclHandle() != get_characteristic(i - 1).getLastHandle() + 1) {
+                break;
+            }
+            if (needs_cccd(i)) {
+                last = i;
+            }
+        }
+        _bulk_next = last + 1;
+
+        _bulk_range.setup(
+            _client,
+            _connection_handle,
+            get_characteristic(first).getProperties(),
+            get_characteristic(first).getDeclHandle(),
+            get_characteristic(first).getValueHandle(),
+            get_characteristic(last).getLastHandle()
+        );
+
+        ble_error_t error = _client->discoverCharacteristicDescriptors(
+            _bulk_range,
+            as_cb(&Self::when_bulk_descriptor_discovered),
+            as_cb(&Self::when_range_discovery_ends)
+        );
+
+        if (error) {
+            printf("Error: cannot initiate discovery of %u-%u due to %u.\r\n",
+                _bulk_range.getValueHandle(), _bulk_range.getLastHandle(), error
+            );
+            stop();
+            return;
+        }
+
+        ++_bulk_ranges;
+    }
+
+    void when_bulk_descriptor_discovered(const DiscoveryCallbackParams_t *event)
+    {
+        if (pass_cancelled()) {
+            return;
+        }
+
+        ++_bulk_attributes;
+
+        if (event->descriptor.getUUID() != BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG) {
+            return;
+        }
+
+        GattAttribute::Handle_t handle = event->descriptor.getAttributeHandle();
+        size_t owner = find_owner(handle);
+        if (owner != NO_CHARACTERISTIC && needs_cccd(owner)) {
+            set_cccd_handle(owner, handle);
+            ++_bulk_cccds;
+        }
+    }
+
+    void when_range_discovery_ends(const TerminationCallbackParams_t *event)
+    {
+        if (pass_cancelled()) {
+            return;
+        }
+
+        if (event->status) {
+            printf("\tWarning: discovery of %u-%u ended with %u.\r\n",
+                _bulk_range.getValueHandle(), _bulk_range.getLastHandle(), event->status
+            );
+        }
+
+        // the stack reports the end of the procedure before releasing it
+        _event_queue->call(mbed::callback(this, &Self::discover_next_range));
+    }
+
+    void when_all_descriptors_discovered()
+    {
+        _bulk_timer.stop();
+
+        // a Find Information response holds (ATT_MTU - 2) / 4 attributes with 16-bit UUIDs
+        size_t per_response = (_att_mtu - 2) / 4;
+        printf(
+            "%u CCCDs found in %d ms with %u descriptor discovery procedures, "
+            "%u attributes walked (at least %u Find Information requests).\r\n",
+            _bulk_cccds,
+            (int) duration_cast<milliseconds>(_bulk_timer.elapsed_time()).count(),
+            _bulk_ranges,
+            _bulk_attributes,
+            (_bulk_attributes + per_response - 1) / per_response
+        );
+
+        _descriptor_discoveries += _bulk_ranges;
+
+        // characteristics without CCCD in the ranges walked are discovered
+        // again individually, like servers which don't follow the specification
+        subscribe_characteristics();
+    }
+
+    /**
+     * Find the characteristic owning a descriptor, characteristics are
+     * discovered in handle order.
+     */
+    size_t find_owner(GattAttribute::Handle_t handle) const
+    {
+        size_t low = 0;
+        size_t high = _characteristic_count;
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (get_characteristic(mid).getLastHandle() < handle) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+
+        if (low < _characteristic_count && get_characteristic(low).getValueHandle() < handle) {
+            return low;
+        }
+        return NO_CHARACTERISTIC;
+    }
+#endif // MBED_CONF_APP_BULK_DESCRIPTOR_DISCOVERY
+
+////////////////////////////////////////////////////////////////////////////////
+// Pipelined processing of characteristics.
+
+#if MBED_CONF_APP_PIPELINED_PROCESSING
+    /**
+     * Start the pipelined processing of the characteristics discovered.
+     *
+     * Instead of handling one characteristic at a time, three cursors walk the
+     * characteristics: one for reads, one for descriptor discovery and one for
+     * CCCD writes. The pipeline issues as many operations as the stack accepts
+     * and is pumped again each time one of them completes. A CCCD write is
+     * issued as soon as its descriptor discovery ends, while the discovery of
+     * the next characteristic starts.
+     */
+    void start_pipeline()
+    {
+        _next_read = 0;
+        _descriptors_done = 0;
+        _next_cccd_write = 0;
+        _reads_in_flight = 0;
+        _writes_in_flight = 0;
+        _discovery_in_flight = false;
+        _busy_count = 0;
+
+        pump_pipeline();
+    }
+
+    /**
+     * Issue all the operations that can be issued.
+     */
+    void pump_pipeline()
+    {
+        _pipeline_retry_event = 0;
+
+        // reads don't depend on anything, issue them back to back
+        while (_next_read < _characteristic_count) {
+            const DiscoveredCharacteristic &characteristic = get_characteristic(_next_read);
+            if (!characteristic.getProperties().read()) {
+                ++_next_read;
+                continue;
+            }
+
+            ble_error_t error = _client->read(_connection_handle, characteristic.getValueHandle(), 0);
+            if (is_busy(error)) {
+                break;
+            } else if (error) {
+                printf("Error: cannot initiate read at %u due to %u\r\n", characteristic.getValueHandle(), error);
+                stop();
+                return;
+            }
+
+            ++_reads_in_flight;
+            ++_next_read;
+        }
+
+        // the stack discovers the descriptors of a single characteristic at a time
+        while (_descriptors_done < _characteristic_count && !needs_cccd(_descriptors_done)) {
+            // characteristics without updates have no CCCD to write, a known one is kept
+            Properties_t properties = get_characteristic(_descriptors_done).getProperties();
+            if (!properties.notify() && !properties.indicate()) {
+                _cccd_handles[_descriptors_done] = 0;
+            }
+            ++_descriptors_done;
+        }
+
+        if (!_discovery_in_flight && _descriptors_done < _characteristic_count) {
+            _descriptor_handle = 0;
+            ble_error_t error = get_characteristic(_descriptors_done).discoverDescriptors(
+                as_cb(&Self::when_descriptor_discovered),
+                as_cb(&Self::when_pipelined_discovery_ends)
+            );
+            if (error && !is_busy(error)) {
+                printf(
+                    "Error: cannot initiate discovery of %04X due to %u.\r\n",
+                    get_characteristic(_descriptors_done).getValueHandle(), error
+                );
+                stop();
+                return;
+            }
+            _discovery_in_flight = !error;
+            if (!error) {
+                ++_descriptor_discoveries;
+            }
+        }
+
+        // subscribe to the characteristics whose descriptors are known
+        while (_next_cccd_write < _descriptors_done) {
+            GattAttribute::Handle_t cccd_handle = _cccd_handles[_next_cccd_write];
+            if (!cccd_handle) {
+                ++_next_cccd_write;
+                continue;
+            }
+
+            Properties_t properties = get_characteristic(_next_cccd_write).getProperties();
+            uint16_t cccd_value = (properties.notify() << 0) | (properties.indicate() << 1);
+
+            ble_error_t error = _client->write(
+                GattClient::GATT_OP_WRITE_REQ,
+                _connection_handle,
+                cccd_handle,
+                sizeof(cccd_value),
+                reinterpret_cast<uint8_t*>(&cccd_value)
+            );
+            if (is_busy(error)) {
+                break;
+            } else if (error) {
+                printf("Error: cannot initiate write of CCCD %u due to %u.\r\n", cccd_handle, error);
+                stop();
+                return;
+            }
+
+            ++_writes_in_flight;
+            ++_next_cccd_write;
+        }
+
+        bool in_flight = _reads_in_flight || _writes_in_flight || _discovery_in_flight;
+
+        if (!in_flight) {
+            if (_next_read == _characteristic_count && _next_cccd_write == _characteristic_count) {
+                printf("All characteristics discovered have been processed, %u times the stack was busy.\r\n", _busy_count);
+                when_processing_ends();
+            } else {
+                // nothing will complete to pump the pipeline, the stack is busy with something else
+                _pipeline_retry_event = _event_queue->call_in(
+                    BUSY_RETRY_DELAY, mbed::callback(this, &Self::pump_pipeline)
+                );
+            }
+        }
+    }
+
+    /**
+     * The stack can't queue more requests, the operation is retried after the
+     * next completion.
+     */
+    bool is_busy(ble_error_t error)
+    {
+        if (error == BLE_STACK_BUSY || error == BLE_ERROR_INVALID_STATE) {
+            ++_busy_count;
+            return true;
+        }
+        return false;
+    }
+
+
+    void when_pipelined_read(const GattReadCallbackParams *read_event)
+    {
+        if (pass_cancelled()) {
+            return;
+        }
+
+        const route_t *route = _dispatch.find(read_event->handle);
+        if (read_event->connHandle != _connection_handle ||
+            !_reads_in_flight ||
+            !route || route->attribute != ATTRIBUTE_VALUE) {
+            return;
+        }
+
+        printf("\tCharacteristic value at %u equal to: ", read_event->handle);
+        print_value(read_event->handle, read_event->data, read_event->len);
+        printf(".\r\n");
+
+        --_reads_in_flight;
+        pump_pipeline();
+    }
+
+    void when_pipelined_discovery_ends(const TerminationCallbackParams_t *event)
+    {
+        if (pass_cancelled()) {
+            return;
+        }
+
+        if (!_descriptor_handle) {
+            printf("\tWarning: characteristic with notify or indicate attribute without CCCD.\r\n");
+        }
+
+        set_cccd_handle(_descriptors_done++, _descriptor_handle);
+        _descriptor_handle = 0;
+        _discovery_in_flight = false;
+        pump_pipeline();
+    }
+
+    void when_pipelined_write(const GattWriteCallbackParams *event)
+    {
+        if (pass_cancelled()) {
+            return;
+        }
+
+        const route_t *route = _dispatch.find(event->handle);
+        if (event->connHandle != _connection_handle ||
+            !_writes_in_flight ||
+            !route || route->attribute != ATTRIBUTE_CCCD) {
+            return;
+        }
+
+        printf("\tCCCD at %u written.\r\n", event->handle);
+        --_writes_in_flight;
+        pump_pipeline();
+    }
+#endif // MBED_CONF_APP_PIPELINED_PROCESSING
+
+    /**
+     * Print the time between the end of the discovery and the last subscription.
+     */
+    void when_processing_ends()
+    {
+        _processing_timer.stop();
+        printf(
+            "Fully subscribed %d ms after the end of the discovery, %u descriptor discovery procedures.\r\n",
+            (int) duration_cast<milliseconds>(_processing_timer.elapsed_time()).count(),
+            _descriptor_discoveries
+        );
+
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+        printf(
+            "Fully subscribed %d ms after the connection, attribute cache %s.\r\n",
+            (int) duration_cast<milliseconds>(_connection_timer.elapsed_time()).count(),
+            _cache_hot ? "hot" : "cold"
+        );
+
+        if (!_cache_hot) {
+            cache_layout();
+        }
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
+
+#if MBED_CONF_APP_THROUGHPUT_BENCHMARK
+        start_throughput_benchmark();
+#endif // MBED_CONF_APP_THROUGHPUT_BENCHMARK
+
+#if MBED_CONF_APP_MAX_LINKS > 1
+        if (_on_subscribed) {
+            _on_subscribed(_connection_handle);
+        }
+#endif // MBED_CONF_APP_MAX_LINKS > 1
+    }
+
+#if MBED_CONF_APP_THROUGHPUT_BENCHMARK
+////////////////////////////////////////////////////////////////////////////////
+// Throughput benchmark.
+
+    /**
+     * Sweep the link settings if the server hosts the throughput test
+     * service; its data characteristic is subscribed with the others.
+     */
+    void start_throughput_benchmark()
+    {
+        GattAttribute::Handle_t data_handle = 0;
+        GattAttribute::Handle_t control_handle = 0;
+
+        for (size_t i = 0; i < _characteristic_count; ++i) {
+            const DiscoveredCharacteristic &characteristic = get_characteristic(i);
+            if (characteristic.getUUID() == UUID(throughput::DATA_UUID)) {
+                data_handle = characteristic.getValueHandle();
+            } else if (characteristic.getUUID() == UUID(throughput::CONTROL_UUID)) {
+                control_handle = characteristic.getValueHandle();
+            }
+        }
+
+        if (!data_handle || !control_handle) {
+            printf("Throughput test service not found, no benchmark.\r\n");
+            return;
+        }
+
+        _throughput_benchmark.start(
+            *_ble, *_event_queue, _connection_handle, data_handle, control_handle, _att_mtu,
+            milliseconds(MBED_CONF_APP_THROUGHPUT_MEASURE_TIME_MS),
+            nullptr
+        );
+    }
+
+    void when_throughput_control_written(const GattWriteCallbackParams *event)
+    {
+        _throughput_benchmark.on_data_written(event);
+    }
+#endif // MBED_CONF_APP_THROUGHPUT_BENCHMARK
+
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+////////////////////////////////////////////////////////////////////////////////
+// Attribute cache.
+
+    /**
+     * Read the Database Hash of a peer whose layout is cached.
+     *
+     * @return false if the peer isn't in the cache and must be discovered.
+     */
+    bool validate_cache()
+    {
+        AttributeCache::entry_t *entry = _cache.find(_peer_address_type, _peer_address);
+        if (!entry) {
+            return false;
+        }
+
+        _database_hash_handle = entry->database_hash_handle;
+        ble_error_t error = _client->read(_connection_handle, _database_hash_handle, 0);
+        if (error) {
+            printf("Error: cannot read the Database Hash due to %u, discover the server.\r\n", error);
+            return false;
+        }
+
+        printf("Peer found in the attribute cache, validate its Database Hash.\r\n");
+        _validating_cache = true;
+        return true;
+    }
+
+    /**
+     * Handle the value of the Database Hash.
+     *
+     * If it is read to validate the cache the characteristics cached are
+     * restored when it matches, otherwise the server is discovered. If it is
+     * read while processing the characteristics it is kept to fill the cache.
+     */
+    void when_database_hash_read(const GattReadCallbackParams *read_event)
+    {
+        if (read_event->connHandle != _connection_handle ||
+            !_database_hash_handle ||
+            read_event->handle != _database_hash_handle) {
+            return;
+        }
+
+        bool valid_read = read_event->status == BLE_ERROR_NONE &&
+            read_event->len == AttributeCache::DATABASE_HASH_SIZE;
+
+        if (!_validating_cache) {
+            if (valid_read) {
+                memcpy(_database_hash, read_event->data, AttributeCache::DATABASE_HASH_SIZE);
+                _database_hash_valid = true;
+            }
+            return;
+        }
+
+        _validating_cache = false;
+
+        AttributeCache::entry_t *entry = _cache.find(_peer_address_type, _peer_address);
+        if (!entry || !valid_read || !AttributeCache::is_valid(*entry, read_event->data, read_event->len)) {
+            printf("Database Hash changed, discover the server again.\r\n");
+            _cache.invalidate(_peer_address_type, _peer_address);
+            launch_discovery();
+            return;
+        }
+
+        clear_characteristics();
+        for (size_t i = 0; i < entry->characteristic_count; ++i) {
+            DiscoveredCharacteristic characteristic;
+            AttributeCache::restore(
+                entry->characteristics[i], _client, _connection_handle, characteristic
+            );
+            if (!add_characteristic(&characteristic)) {
+                printf("Cached layout doesn't fit, discover the server again.\r\n");
+                clear_characteristics();
+                launch_discovery();
+                return;
+            }
+            _cccd_handles[i] = entry->characteristics[i].cccd_handle;
+            track_gatt_service_characteristic(characteristic);
+        }
+
+        printf(
+            "Database Hash unchanged, %u characteristics restored from the cache.\r\n",
+            _characteristic_count
+        );
+
+        _cache_hot = true;
+        process_characteristics();
+    }
+
+    /**
+     * Record the handles of the characteristics used to validate the cache.
+     */
+    void track_gatt_service_characteristic(const DiscoveredCharacteristic &characteristic)
+    {
+        if (characteristic.getUUID() == UUID(DATABASE_HASH_UUID)) {
+            _database_hash_handle = characteristic.getValueHandle();
+        } else if (characteristic.getUUID() == UUID(SERVICE_CHANGED_UUID)) {
+            _service_changed_handle = characteristic.getValueHandle();
+        }
+    }
+
+    /**
+     * Record the layout of the server once all characteristics are processed.
+     */
+    void cache_layout()
+    {
+        if (!_database_hash_valid) {
+            printf("The server doesn't expose its Database Hash, its layout isn't cached.\r\n");
+            return;
+        }
+
+        AttributeCache::entry_t &entry = _cache.store(_peer_address_type, _peer_address);
+        entry.database_hash_handle = _database_hash_handle;
+        memcpy(entry.database_hash, _database_hash, AttributeCache::DATABASE_HASH_SIZE);
+
+        for (size_t i = 0; i < _characteristic_count; ++i) {
+            AttributeCache::add(entry, get_characteristic(i), _cccd_handles[i]);
+        }
+
+        printf("Layout of the server cached, %u characteristics.\r\n", entry.characteristic_count);
+    }
+
+    /**
+     * The layout of the server changed, forget it and discover it again.
+     */
+    void when_service_changed()
+    {
+        printf("Service Changed indication received, invalidate the attribute cache.\r\n");
+        _cache.invalidate(_peer_address_type, _peer_address);
+        _cache_hot = false;
+        cancel_pass();
+        relaunch_discovery();
+    }
+
+    /**
+     * Abandon the discovery or processing in progress, like stop() does.
+     *
+     * Operations already issued still complete, their callbacks are dropped
+     * until the discovery is relaunched.
+     */
+    void cancel_pass()
+    {
+        _validating_cache = false;
+#if MBED_CONF_APP_PIPELINED_PROCESSING
+        _event_queue->cancel(_pipeline_retry_event);
+        _pipeline_retry_event = 0;
+        _next_read = 0;
+        _descriptors_done = 0;
+        _next_cccd_write = 0;
+        _reads_in_flight = 0;
+        _writes_in_flight = 0;
+        _discovery_in_flight = false;
+#endif // MBED_CONF_APP_PIPELINED_PROCESSING
+#if MBED_CONF_APP_LONG_READS
+        _long_reader.cancel();
+#endif // MBED_CONF_APP_LONG_READS
+#if MBED_CONF_APP_BULK_DESCRIPTOR_DISCOVERY
+        _bulk_next = 0;
+#endif // MBED_CONF_APP_BULK_DESCRIPTOR_DISCOVERY
+
+        clear_characteristics();
+        _it = NO_CHARACTERISTIC;
+        _descriptor_handle = 0;
+        _pass_cancelled = true;
+    }
+
+    void schedule_relaunch(milliseconds delay)
+    {
+        _event_queue->cancel(_relaunch_event);
+        _relaunch_event = _event_queue->call_in(delay, mbed::callback(this, &Self::relaunch_discovery));
+    }
+
+    /**
+     * Discover the server again once the procedure of the cancelled pass is
+     * released by the stack.
+     */
+    void relaunch_discovery()
+    {
+        _relaunch_event = 0;
+        if (!_pass_cancelled) {
+            return;
+        }
+
+        ble_error_t error = launch_discovery();
+        if (error == BLE_STACK_BUSY || error == BLE_ERROR_INVALID_STATE) {
+            // a procedure of the cancelled pass is still running
+            schedule_relaunch(BUSY_RETRY_DELAY);
+            return;
+        }
+
+        // the stack runs a single procedure per connection, nothing of the
+        // cancelled pass is left once the discovery is accepted
+        _pass_cancelled = false;
+    }
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
+
+    /**
+     * Print the updated value of the characteristic.
+     *
+     * This function is called when the server emits a notification or an
+     * indication of a characteristic value the client has subscribed to.
      *
      * @see GattClient::onHVX()
      */
     void when_characteristic_changed(const GattHVXCallbackParams* event)
     {
-        printf("Change on attribute %u: new value = ", event->handle);
-        for (size_t i = 0; i < event->len; ++i) {
-            printf("0x%02X ", event->data[i]);
+        if (event->connHandle != _connection_handle) {
+            return;
+        }
+
+#if MBED_CONF_APP_THROUGHPUT_BENCHMARK
+        if (_throughput_benchmark.on_hvx(event)) {
+            return;
         }
+#endif // MBED_CONF_APP_THROUGHPUT_BENCHMARK
+
+#if MBED_CONF_APP_NOTIFICATION_RING
+        // only copy the value, it is processed later out of the BLE callback
+        _notifications.push(
+            event->connHandle, event->handle, event->data, event->len,
+            duration_cast<microseconds>(_ingestion_clock.elapsed_time()).count()
+        );
+
+        if (!_drain_pending) {
+            _drain_pending = true;
+            _event_queue->call(mbed::callback(this, &Self::drain_notifications));
+        }
+#else
+        printf("Change on attribute %u: new value = ", event->handle);
+        print_value(event->handle, event->data, event->len);
         printf(".\r\n");
+#endif // MBED_CONF_APP_NOTIFICATION_RING
+
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+        if (event->connHandle == _connection_handle &&
+            _service_changed_handle &&
+            event->handle == _service_changed_handle) {
+            _event_queue->call(mbed::callback(this, &Self::when_service_changed));
+        }
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
     }
 
-    struct DiscoveredCharacteristicNode {
-        DiscoveredCharacteristicNode(const DiscoveredCharacteristic &c) :
-            value(c), next(nullptr) { }
+#if MBED_CONF_APP_NOTIFICATION_RING
+    /**
+     * Hand the notifications received to the consumers in batches.
+     */
+    void drain_notifications()
+    {
+        _drain_pending = false;
+        notification_ring::drain(
+            _notifications,
+            _notification_consumers,
+            sizeof(_notification_consumers) / sizeof(_notification_consumers[0]),
+            duration_cast<microseconds>(_ingestion_clock.elapsed_time()).count()
+        );
+    }
 
-        DiscoveredCharacteristic value;
-        DiscoveredCharacteristicNode *next;
-    };
+    /**
+     * Consumer forwarding the notifications to the console.
+     */
+    static void print_notifications(void *context, const notification_t *entries, size_t count)
+    {
+#if MBED_CONF_APP_PRINT_NOTIFICATIONS
+        for (size_t i = 0; i < count; ++i) {
+            const notification_t &entry = entries[i];
+            size_t length = entry.length < NOTIFICATION_PAYLOAD ? entry.length : NOTIFICATION_PAYLOAD;
+
+            printf("Change on attribute %u: new value = ", entry.handle);
+            static_cast<Self*>(context)->print_value(entry.handle, entry.data, length);
+            printf(length < entry.length ? "... .\r\n" : ".\r\n");
+        }
+#endif // MBED_CONF_APP_PRINT_NOTIFICATIONS
+    }
+
+    void print_notification_stats()
+    {
+        if (!_notification_stats.notifications() && !_notifications.drops()) {
+            return;
+        }
+
+        printf(
+            "Notifications: %lu received, %lu bytes, max %lu/s, %lu dropped, %lu truncated, "
+            "%lu batches of up to %lu, max queuing %lu us, last value %lu at %u.\r\n",
+            (unsigned long) _notification_stats.notifications(),
+            (unsigned long) _notification_stats.bytes(),
+            (unsigned long) _notification_stats.max_rate(),
+            (unsigned long) _notifications.drops(),
+            (unsigned long) _notifications.truncated(),
+            (unsigned long) _notification_stats.batches(),
+            (unsigned long) _notification_stats.max_batch(),
+            (unsigned long) _notification_stats.max_latency_us(),
+            (unsigned long) _notification_decoder.last_value(),
+            _notification_decoder.last_handle()
+        );
+    }
+#endif // MBED_CONF_APP_NOTIFICATION_RING
 
     /**
      * Add a discovered characteristic into the list of discovered characteristics.
+     *
+     * Characteristics are copied in a fixed array, appending one is a constant
+     * time operation which never touches the heap.
      */
     bool add_characteristic(const DiscoveredCharacteristic *characteristic)
     {
-        DiscoveredCharacteristicNode* new_node =
-            new(std::nothrow) DiscoveredCharacteristicNode(*characteristic);
+        if (_characteristic_count == MAX_CHARACTERISTICS) {
+            return false;
+        }
 
-        if (new_node == nullptr) {
-            printf("Error while allocating a new characteristic.\r\n");
+#if MBED_CONF_APP_COMPACT_CHARACTERISTICS
+        if (!_characteristic_table.add(*characteristic)) {
             return false;
         }
+        _cccd_handles[_characteristic_count++] = 0;
+#else
+        _cccd_handles[_characteristic_count] = 0;
+        _characteristics[_characteristic_count++] = *characteristic;
+#endif // MBED_CONF_APP_COMPACT_CHARACTERISTICS
+        return true;
+    }
+
+#if MBED_CONF_APP_COMPACT_CHARACTERISTICS
+    /**
+     * Get a characteristic discovered.
+     *
+     * The characteristic is rebuilt from the compact table, copy it rather
+     * than calling this repeatedly.
+     */
+    DiscoveredCharacteristic get_characteristic(size_t index) const
+    {
+        DiscoveredCharacteristic characteristic;
+        _characteristic_table.get(index, _client, _connection_handle, characteristic);
+        return characteristic;
+    }
+#else
+    /** Get a characteristic discovered */
+    const DiscoveredCharacteristic &get_characteristic(size_t index) const
+    {
+        return _characteristics[index];
+    }
+#endif // MBED_CONF_APP_COMPACT_CHARACTERISTICS
+
+////////////////////////////////////////////////////////////////////////////////
+// Dispatch of the events received to the characteristics.
+
+    /**
+     * Index the value and CCCD handles of the characteristics.
+     *
+     * Characteristics are in handle order, each entry is appended to the
+     * table without moving the others.
+     */
+    void build_dispatch_table()
+    {
+        _dispatch.clear();
+
+        for (size_t i = 0; i < _characteristic_count; ++i) {
+            const DiscoveredCharacteristic &characteristic = get_characteristic(i);
+            _dispatch.add(characteristic.getValueHandle(), route_t { (uint16_t) i, ATTRIBUTE_VALUE });
+            if (_cccd_handles[i]) {
+                _dispatch.add(_cccd_handles[i], route_t { (uint16_t) i, ATTRIBUTE_CCCD });
+            }
+
+            _value_printers[i] = &Self::print_hex;
+            if (characteristic.getUUID() == UUID(BATTERY_LEVEL_UUID)) {
+                _value_printers[i] = &Self::print_battery_level;
+            } else if (characteristic.getUUID() == UUID(HEART_RATE_MEASUREMENT_UUID)) {
+                _value_printers[i] = &Self::print_heart_rate_measurement;
+            }
+        }
+    }
+
+    /**
+     * Record the CCCD of a characteristic once discovered.
+     */
+    void set_cccd_handle(size_t index, GattAttribute::Handle_t handle)
+    {
+        _cccd_handles[index] = handle;
+        if (handle) {
+            _dispatch.add(handle, route_t { (uint16_t) index, ATTRIBUTE_CCCD });
+        }
+    }
+
+    /**
+     * Print a value with the printer of the characteristic it belongs to.
+     */
+    void print_value(GattAttribute::Handle_t handle, const uint8_t *data, size_t length)
+    {
+        const route_t *route = _dispatch.find(handle);
+        if (route && route->attribute == ATTRIBUTE_VALUE) {
+            (this->*_value_printers[route->characteristic])(data, length);
+        } else {
+            print_hex(data, length);
+        }
+    }
+
+    void print_hex(const uint8_t *data, size_t length)
+    {
+        for (size_t i = 0; i < length; ++i) {
+            printf("0x%02X ", data[i]);
+        }
+    }
+
+    void print_battery_level(const uint8_t *data, size_t length)
+    {
+        if (length != 1) {
+            print_hex(data, length);
+            return;
+        }
+        printf("%u%% ", data[0]);
+    }
 
-        if (_characteristics == nullptr) {
-            _characteristics = new_node;
+    void print_heart_rate_measurement(const uint8_t *data, size_t length)
+    {
+        // the first bit of the flags tells if the value is on 8 or 16 bits
+        if (length >= 3 && (data[0] & 0x01)) {
+            printf("%u bpm ", data[1] | (data[2] << 8));
+        } else if (length >= 2) {
+            printf("%u bpm ", data[1]);
         } else {
-            DiscoveredCharacteristicNode* c = _characteristics;
-            while(c->next) {
-                c = c->next;
+            print_hex(data, length);
+        }
+    }
+
+#if MBED_CONF_APP_DISPATCH_BENCHMARK
+    /**
+     * Compare lookups in a dispatch table with a linear search of the
+     * handles, for tables of different sizes.
+     */
+    static void run_dispatch_benchmark()
+    {
+        static HandleDispatchTable<1000, route_t> table;
+        static uint16_t handles[1000];
+
+        for (size_t size : DISPATCH_BENCHMARK_SIZES) {
+            // handles spaced like the value handles of characteristics with a CCCD
+            table.clear();
+            for (size_t i = 0; i < size; ++i) {
+                handles[i] = 3 + 4 * i;
+                table.add(handles[i], route_t { (uint16_t) i, ATTRIBUTE_VALUE });
+            }
+
+            mbed::Timer timer;
+            uint32_t seed = 1;
+            uint32_t found = 0;
+
+            timer.start();
+            for (size_t n = 0; n < DISPATCH_BENCHMARK_LOOKUPS; ++n) {
+                seed = seed * 1664525 + 1013904223;
+                const route_t *route = table.find(handles[(seed >> 8) % size]);
+                found += route->characteristic;
             }
-            c->next = new_node;
+            timer.stop();
+            uint32_t table_ns = duration_cast<nanoseconds>(timer.elapsed_time()).count() / DISPATCH_BENCHMARK_LOOKUPS;
+
+            timer.reset();
+            seed = 1;
+            timer.start();
+            for (size_t n = 0; n < DISPATCH_BENCHMARK_LOOKUPS; ++n) {
+                seed = seed * 1664525 + 1013904223;
+                uint16_t handle = handles[(seed >> 8) % size];
+                size_t i = 0;
+                while (handles[i] != handle) {
+                    ++i;
+                }
+                found -= i;
+            }
+            timer.stop();
+            uint32_t linear_ns = duration_cast<nanoseconds>(timer.elapsed_time()).count() / DISPATCH_BENCHMARK_LOOKUPS;
+
+            printf(
+                "Dispatch of %u handles: %lu ns per lookup in the table, %lu ns with a linear search%s.\r\n",
+                (unsigned) size, (unsigned long) table_ns, (unsigned long) linear_ns,
+                found ? " (mismatch)" : ""
+            );
         }
+    }
+#endif // MBED_CONF_APP_DISPATCH_BENCHMARK
 
-        return true;
+    /**
+     * Check if a characteristic can notify or indicate and its CCCD isn't
+     * known yet, from the cache or a previous discovery.
+     */
+    bool needs_cccd(size_t index) const
+    {
+        Properties_t properties = get_characteristic(index).getProperties();
+        return (properties.notify() || properties.indicate()) && !_cccd_handles[index];
     }
 
     /**
@@ -462,13 +1882,60 @@ private:
      */
     void clear_characteristics(void)
     {
-        DiscoveredCharacteristicNode *c= _characteristics;
+        _characteristic_count = 0;
+#if MBED_CONF_APP_COMPACT_CHARACTERISTICS
+        _characteristic_table.clear();
+#endif // MBED_CONF_APP_COMPACT_CHARACTERISTICS
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+        _database_hash_handle = 0;
+        _service_changed_handle = 0;
+        _database_hash_valid = false;
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
+    }
 
-        while (c) {
-            DiscoveredCharacteristicNode *n = c->next;
-            delete c;
-            c = n;
-        }
+    /**
+     * Print the time taken by the discovery and the heap usage.
+     *
+     * Heap statistics are only available if platform.heap-stats-enabled is set.
+     */
+    void print_discovery_stats()
+    {
+        printf(
+            "%u characteristics discovered in %d ms.\r\n",
+            _characteristic_count,
+            (int) duration_cast<milliseconds>(_discovery_timer.elapsed_time()).count()
+        );
+
+#if MBED_CONF_APP_FILTERED_DISCOVERY
+        printf(
+            "%u of %u wanted characteristics found, %u services discovered.\r\n",
+            _discovery_filter.found(),
+            _discovery_filter.size(),
+            _discovery_filter.services()
+        );
+#endif // MBED_CONF_APP_FILTERED_DISCOVERY
+
+#if MBED_CONF_APP_COMPACT_CHARACTERISTICS
+        printf(
+            "Characteristics stored in %u bytes (%u UUID bases, %u UUIDs stored in full), "
+            "%u bytes as DiscoveredCharacteristic.\r\n",
+            _characteristic_table.used_bytes(),
+            _characteristic_table.base_count(),
+            _characteristic_table.full_uuid_count(),
+            _characteristic_count * sizeof(DiscoveredCharacteristic)
+        );
+#endif // MBED_CONF_APP_COMPACT_CHARACTERISTICS
+
+#if MBED_HEAP_STATS_ENABLED
+        mbed_stats_heap_t heap_stats;
+        mbed_stats_heap_get(&heap_stats);
+        printf(
+            "Heap: %lu bytes in use, high-water mark %lu bytes, %lu allocations.\r\n",
+            (unsigned long) heap_stats.current_size,
+            (unsigned long) heap_stats.max_size,
+            (unsigned long) heap_stats.alloc_cnt
+        );
+#endif // MBED_HEAP_STATS_ENABLED
     }
 
     /**
@@ -527,17 +1994,379 @@ private:
     GattClient *_client = nullptr;
 
     ble::connection_handle_t _connection_handle = 0;
-    DiscoveredCharacteristicNode *_characteristics = nullptr;
-    DiscoveredCharacteristicNode *_it = nullptr;
+    uint16_t _att_mtu = DEFAULT_ATT_MTU;
+
+    /* characteristics discovered, the storage is reused by each connection */
+#if MBED_CONF_APP_COMPACT_CHARACTERISTICS
+    CharacteristicTable _characteristic_table;
+#else
+    DiscoveredCharacteristic _characteristics[MAX_CHARACTERISTICS];
+#endif // MBED_CONF_APP_COMPACT_CHARACTERISTICS
+    size_t _characteristic_count = 0;
+    /* CCCD handle of each characteristic, 0 until discovered */
+    GattAttribute::Handle_t _cccd_handles[MAX_CHARACTERISTICS];
+    value_printer_t _value_printers[MAX_CHARACTERISTICS];
+    DispatchTable _dispatch;
+#if MBED_CONF_APP_FILTERED_DISCOVERY
+    GattDiscoveryFilter<MAX_WANTED_CHARACTERISTICS> _discovery_filter;
+#endif // MBED_CONF_APP_FILTERED_DISCOVERY
+    /* index of the characteristic being processed */
+    size_t _it = NO_CHARACTERISTIC;
+    unsigned int _descriptor_discoveries = 0;
+
     GattAttribute::Handle_t _descriptor_handle = 0;
+
+    mbed::Timer _discovery_timer;
+    mbed::Timer _processing_timer;
+
+#if MBED_CONF_APP_PIPELINED_PROCESSING
+    /* cursors of the pipeline in the characteristics discovered */
+    size_t _next_read = 0;
+    size_t _descriptors_done = 0;
+    size_t _next_cccd_write = 0;
+
+    size_t _reads_in_flight = 0;
+    size_t _writes_in_flight = 0;
+    bool _discovery_in_flight = false;
+    unsigned int _busy_count = 0;
+    int _pipeline_retry_event = 0;
+#endif // MBED_CONF_APP_PIPELINED_PROCESSING
+
+#if MBED_CONF_APP_BULK_DESCRIPTOR_DISCOVERY
+    /* synthetic characteristic spanning the range walked */
+    DiscoveredCharacteristic _bulk_range;
+    size_t _bulk_next = 0;
+    unsigned int _bulk_ranges = 0;
+    unsigned int _bulk_attributes = 0;
+    unsigned int _bulk_cccds = 0;
+    mbed::Timer _bulk_timer;
+#endif // MBED_CONF_APP_BULK_DESCRIPTOR_DISCOVERY
+
+#if MBED_CONF_APP_LONG_READS
+    GattLongReader _long_reader;
+    uint8_t _long_read_buffer[MBED_CONF_APP_LONG_READ_BUFFER_SIZE];
+    mbed::Timer _long_read_timer;
+#endif // MBED_CONF_APP_LONG_READS
+
+#if MBED_CONF_APP_NOTIFICATION_RING
+    NotificationRing _notifications;
+    bool _drain_pending = false;
+    mbed::Timer _ingestion_clock;
+
+    notification_ring::Statistics<NOTIFICATION_PAYLOAD> _notification_stats;
+    notification_ring::Decoder<NOTIFICATION_PAYLOAD> _notification_decoder;
+    notification_ring::Forwarder<NOTIFICATION_PAYLOAD> _notification_forwarder { &Self::print_notifications, this };
+    notification_ring::Consumer<NOTIFICATION_PAYLOAD> *_notification_consumers[3] = {
+        &_notification_stats,
+        &_notification_decoder,
+        &_notification_forwarder
+    };
+#endif // MBED_CONF_APP_NOTIFICATION_RING
+
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+    /* shared by the links, a peer can reconnect on any of them */
+    static AttributeCache _cache;
+    ble::peer_address_type_t _peer_address_type;
+    ble::address_t _peer_address;
+    bool _validating_cache = false;
+    bool _cache_hot = false;
+    /* a Service Changed indication cancelled the pass in progress */
+    bool _pass_cancelled = false;
+    int _relaunch_event = 0;
+
+    GattAttribute::Handle_t _database_hash_handle = 0;
+    GattAttribute::Handle_t _service_changed_handle = 0;
+    uint8_t _database_hash[AttributeCache::DATABASE_HASH_SIZE];
+    bool _database_hash_valid = false;
+
+    mbed::Timer _connection_timer;
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
+
+#if MBED_CONF_APP_THROUGHPUT_BENCHMARK
+    ThroughputBenchmark _throughput_benchmark;
+    ChainableGapEventHandler _gap_event_handlers;
+    ble::Gap::EventHandler *_process_gap_event_handler = nullptr;
+#endif // MBED_CONF_APP_THROUGHPUT_BENCHMARK
+
+#if MBED_CONF_APP_MAX_LINKS > 1
+    mbed::Callback<void(ble::connection_handle_t)> _on_subscribed;
+#endif // MBED_CONF_APP_MAX_LINKS > 1
+};
+
+#if MBED_CONF_APP_ATTRIBUTE_CACHE
+GattClientDemo::AttributeCache GattClientDemo::_cache;
+#endif // MBED_CONF_APP_ATTRIBUTE_CACHE
+
+#if MBED_CONF_APP_MAX_LINKS > 1
+/**
+ * Connect to several GATT servers and process them in parallel.
+ *
+ * The application scans for devices named "GattServer" and connects to them
+ * one after the other until max-links links are up. Each link has its own
+ * GattClientDemo, so the discoveries and subscriptions of the servers progress
+ * in parallel. The link of an event is found from its connection handle in a
+ * dispatch table. GattClient delivers some events to a single handler: the
+ * end of the service discovery and the ATT_MTU changes. They are dispatched
+ * to the link they belong to.
+ *
+ * It replaces GattClientProcess, which handles a single connection.
+ */
+class GattClientLinks : private mbed::NonCopyable<GattClientLinks>,
+                        public ble::Gap::EventHandler,
+                        public GattClient::EventHandler {
+    typedef GattClientLinks Self;
+
+public:
+    static const size_t MAX_LINKS = MBED_CONF_APP_MAX_LINKS;
+
+    /**
+     * Initialise BLE and dispatch the events of the links, doesn't return.
+     */
+    void start(BLE &ble, events::EventQueue &event_queue)
+    {
+        _ble = &ble;
+        _event_queue = &event_queue;
+
+        ble_error_t error = _ble->init(this, &Self::when_init_complete);
+        if (error) {
+            printf("Error %u returned by BLE::init.\r\n", error);
+            return;
+        }
+
+        _event_queue->dispatch_forever();
+    }
+
+private:
+    void when_init_complete(BLE::InitializationCompleteCallbackContext *event)
+    {
+        if (event->error) {
+            printf("Error %u during the initialisation.\r\n", event->error);
+            return;
+        }
+
+        for (size_t i = 0; i < MAX_LINKS; ++i) {
+            _links[i].start(*_ble, *_event_queue);
+            _links[i].on_subscribed(mbed::callback(this, &Self::when_link_subscribed));
+        }
+
+        _ble->gap().setEventHandler(this);
+        _ble->gattClient().setEventHandler(this);
+        _ble->gattClient().onServiceDiscoveryTermination(
+            makeFunctionPointer(this, &Self::when_service_discovery_ends)
+        );
+
+        ble_error_t error = _ble->gap().setScanParameters(
+            ble::ScanParameters(ble::phy_t::LE_1M, ble::scan_interval_t(80), ble::scan_window_t(60))
+        );
+        if (error) {
+            printf("Error %u returned by Gap::setScanParameters.\r\n", error);
+            return;
+        }
+
+        printf("Looking for up to %u GATT servers.\r\n", MAX_LINKS);
+        _bring_up_timer.start();
+        start_scan();
+    }
+
+    void start_scan()
+    {
+        if (_scanning || _connecting || _links_up == MAX_LINKS) {
+            return;
+        }
+
+        ble_error_t error = _ble->gap().startScan();
+        if (error) {
+            printf("Error %u returned by Gap::startScan.\r\n", error);
+            return;
+        }
+        _scanning = true;
+    }
+
+    GattClientDemo *find_link(ble::connection_handle_t connection_handle)
+    {
+        const uint8_t *index = _link_table.find(connection_handle);
+        return index ? &_links[*index] : nullptr;
+    }
+
+    /**
+     * Print the time taken to bring the links to the subscribed state.
+     */
+    void when_link_subscribed(ble::connection_handle_t connection_handle)
+    {
+        const uint8_t *index = _link_table.find(connection_handle);
+        if (!index || _link_subscribed[*index]) {
+            return;
+        }
+
+        _link_subscribed[*index] = true;
+        ++_links_subscribed;
+        int elapsed_ms = (int) duration_cast<milliseconds>(_bring_up_timer.elapsed_time()).count();
+
+        printf(
+            "Link %u subscribed, %u/%u links subscribed %d ms after the start.\r\n",
+            connection_handle, _links_subscribed, MAX_LINKS, elapsed_ms
+        );
+
+        if (_links_subscribed == MAX_LINKS) {
+            printf("All %u peers subscribed in %d ms.\r\n", MAX_LINKS, elapsed_ms);
+        }
+    }
+
+    void when_service_discovery_ends(ble::connection_handle_t connection_handle)
+    {
+        GattClientDemo *link = find_link(connection_handle);
+        if (link) {
+            link->end_service_discovery(connection_handle);
+        }
+    }
+
+    /* Gap::EventHandler */
+
+    void onAdvertisingReport(const ble::AdvertisingReportEvent &event) override
+    {
+        if (_connecting || !event.getType().connectable()) {
+            return;
+        }
+
+        ble::AdvertisingDataParser adv_parser(event.getPayload());
+
+        while (adv_parser.hasNext()) {
+            ble::AdvertisingDataParser::element_t field = adv_parser.next();
+
+            if (field.type != ble::adv_data_type_t::COMPLETE_LOCAL_NAME ||
+                field.value.size() != sizeof(PEER_NAME) - 1 ||
+                memcmp(field.value.data(), PEER_NAME, sizeof(PEER_NAME) - 1) != 0) {
+                continue;
+            }
+
+            // a single connection can be initiated at a time
+            _ble->gap().stopScan();
+            _scanning = false;
+
+            ble_error_t error = _ble->gap().connect(
+                event.getPeerAddressType(),
+                event.getPeerAddress(),
+                ble::ConnectionParameters()
+            );
+            if (error) {
+                printf("Error %u returned by Gap::connect.\r\n", error);
+                start_scan();
+                return;
+            }
+
+            _connecting = true;
+            return;
+        }
+    }
+
+    void onConnectionComplete(const ble::ConnectionCompleteEvent &event) override
+    {
+        _connecting = false;
+
+        if (event.getStatus()) {
+            printf("Error %u during the connection.\r\n", event.getStatus());
+            start_scan();
+            return;
+        }
+
+        size_t index = 0;
+        while (_link_used[index]) {
+            ++index;
+        }
+
+        _link_used[index] = true;
+        _link_table.add(event.getConnectionHandle(), (uint8_t) index);
+        ++_links_up;
+
+        printf(
+            "Link %u up, %u/%u links.\r\n",
+            event.getConnectionHandle(), _links_up, MAX_LINKS
+        );
+
+        _links[index].start_discovery(*_ble, *_event_queue, event);
+        start_scan();
+    }
+
+    void onDisconnectionComplete(const ble::DisconnectionCompleteEvent &event) override
+    {
+        const uint8_t *index = _link_table.find(event.getConnectionHandle());
+        if (!index) {
+            return;
+        }
+
+        printf("Link %u down.\r\n", event.getConnectionHandle());
+
+        _links[*index].stop();
+        _link_used[*index] = false;
+        if (_link_subscribed[*index]) {
+            _link_subscribed[*index] = false;
+            --_links_subscribed;
+        }
+        _link_table.remove(event.getConnectionHandle());
+        --_links_up;
+
+        // measure the time taken to bring the links back
+        _bring_up_timer.reset();
+        _bring_up_timer.start();
+        start_scan();
+    }
+
+    /* GattClient::EventHandler */
+
+    void onAttMtuChange(ble::connection_handle_t connectionHandle, uint16_t attMtuSize) override
+    {
+        GattClient::EventHandler *link = find_link(connectionHandle);
+        if (link) {
+            link->onAttMtuChange(connectionHandle, attMtuSize);
+        }
+    }
+
+private:
+    static constexpr char PEER_NAME[] = "GattServer";
+
+    BLE *_ble = nullptr;
+    events::EventQueue *_event_queue = nullptr;
+
+    GattClientDemo _links[MAX_LINKS];
+    bool _link_used[MAX_LINKS] = { false };
+    bool _link_subscribed[MAX_LINKS] = { false };
+    /* index of the link of each connection handle */
+    HandleDispatchTable<MAX_LINKS, uint8_t> _link_table;
+
+    bool _scanning = false;
+    bool _connecting = false;
+    size_t _links_up = 0;
+    size_t _links_subscribed = 0;
+    mbed::Timer _bring_up_timer;
 };
 
+constexpr char GattClientLinks::PEER_NAME[];
+
+/* the links are too large for the stack of main */
+static events::EventQueue links_event_queue(/* event count */ 16 * EVENTS_EVENT_SIZE);
+static GattClientLinks links;
+
+/** Schedule processing of events from the BLE middleware in the event queue. */
+void schedule_ble_events(BLE::OnEventsToProcessCallbackContext *context)
+{
+    links_event_queue.call(mbed::callback(&context->ble, &BLE::processEvents));
+}
+#endif // MBED_CONF_APP_MAX_LINKS > 1
+
 
 int main()
 {
     mbed_trace_init();
 
     BLE &ble = BLE::Instance();
+
+#if MBED_CONF_APP_MAX_LINKS > 1
+    /* this will inform us off all events so we can schedule their handling
+     * using our event queue */
+    ble.onEventsToProcess(schedule_ble_events);
+
+    links.start(ble, links_event_queue);
+#else
     events::EventQueue event_queue;
 
     GattClientDemo demo;
@@ -545,11 +2374,16 @@ int main()
     /* this process will handle basic ble setup and advertising for us */
     GattClientProcess ble_process(event_queue, ble);
 
+#if MBED_CONF_APP_THROUGHPUT_BENCHMARK
+    demo.set_process_gap_event_handler(&ble_process);
+#endif // MBED_CONF_APP_THROUGHPUT_BENCHMARK
+
     /* once it's done it will let us continue with our demo */
     ble_process.on_init(mbed::callback(&demo, &GattClientDemo::start));
     ble_process.on_connect(mbed::callback(&demo, &GattClientDemo::start_discovery));
 
     ble_process.start();
+#endif // MBED_CONF_APP_MAX_LINKS > 1
 
     return 0;
 }
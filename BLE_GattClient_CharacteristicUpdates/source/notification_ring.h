@@ -0,0 +1,353 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOTIFICATION_RING_H_
+#define NOTIFICATION_RING_H_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Ingestion of notifications and indications received at a high rate.
+ *
+ * The BLE callback only copies the payload in a ring along with the time it
+ * was received; the entries are handed later to consumers in batches, out of
+ * the BLE callback.
+ *
+ * Nothing here depends on Mbed OS, time is passed in by the caller.
+ */
+namespace notification_ring {
+
+/**
+ * Notification copied in the ring.
+ *
+ * @tparam MaxPayload Payload bytes kept, longer payloads are truncated.
+ */
+template<size_t MaxPayload>
+struct entry_t {
+    uint32_t timestamp_us;
+    uint16_t connection_handle;
+    uint16_t handle;
+    /* length of the payload received, data holds at most MaxPayload bytes */
+    uint16_t length;
+    uint8_t data[MaxPayload];
+};
+
+/**
+ * Single producer, single consumer ring of notifications.
+ *
+ * The producer and the consumer only share the head and tail indexes, the
+ * ring never blocks: notifications received while it is full are dropped and
+ * counted.
+ *
+ * @tparam Capacity Number of entries, must be a power of two.
+ * @tparam MaxPayload Payload bytes kept per entry.
+ */
+template<size_t Capacity, size_t MaxPayload>
+class Ring {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    typedef entry_t<MaxPayload> entry_type;
+
+    /**
+     * Copy a notification in the ring, called by the producer.
+     *
+     * @return false if the ring is full and the notification dropped.
+     */
+    bool push(uint16_t connection_handle, uint16_t handle, const uint8_t *data, uint16_t length, uint32_t now_us)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t tail = _tail.load(std::memory_order_acquire);
+
+        if (head - tail == Capacity) {
+            _drops++;
+            return false;
+        }
+
+        entry_type &entry = _entries[head & (Capacity - 1)];
+        entry.timestamp_us = now_us;
+        entry.connection_handle = connection_handle;
+        entry.handle = handle;
+        entry.length = length;
+
+        size_t copied = length;
+        if (copied > MaxPayload) {
+            copied = MaxPayload;
+            _truncated++;
+        }
+        memcpy(entry.data, data, copied);
+
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Get the entries available to the consumer.
+     *
+     * @param[out] entries First entry available.
+     *
+     * @return Number of contiguous entries, more can be available after they
+     * are released if the ring wrapped.
+     */
+    size_t peek(const entry_type **entries) const
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t head = _head.load(std::memory_order_acquire);
+
+        size_t available = head - tail;
+        size_t index = tail & (Capacity - 1);
+        if (available > Capacity - index) {
+            available = Capacity - index;
+        }
+
+        *entries = &_entries[index];
+        return available;
+    }
+
+    /** Release entries consumed, called by the consumer */
+    void release(size_t count)
+    {
+        _tail.store(_tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    bool empty() const
+    {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_relaxed);
+    }
+
+    /** Notifications dropped because the ring was full */
+    uint32_t drops() const
+    {
+        return _drops;
+    }
+
+    /** Notifications longer than the payload kept */
+    uint32_t truncated() const
+    {
+        return _truncated;
+    }
+
+private:
+    entry_type _entries[Capacity];
+    std::atomic<uint32_t> _head = { 0 };
+    std::atomic<uint32_t> _tail = { 0 };
+    /* only written by the producer */
+    uint32_t _drops = 0;
+    uint32_t _truncated = 0;
+};
+
+/**
+ * Process batches of notifications taken from the ring.
+ */
+template<size_t MaxPayload>
+class Consumer {
+public:
+    virtual ~Consumer() { }
+
+    /**
+     * Process a batch of notifications.
+     *
+     * @param[in] entries Notifications in the order they were received.
+     * @param[in] count Number of notifications.
+     * @param[in] now_us Current time in microseconds.
+     */
+    virtual void consume(const entry_t<MaxPayload> *entries, size_t count, uint32_t now_us) = 0;
+};
+
+/**
+ * Measure the rate of notifications and the time they wait in the ring.
+ */
+template<size_t MaxPayload>
+class Statistics : public Consumer<MaxPayload> {
+public:
+    /* rate is measured over windows of this length */
+    static const uint32_t WINDOW_US = 1000000;
+
+    virtual void consume(const entry_t<MaxPayload> *entries, size_t count, uint32_t now_us)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            const entry_t<MaxPayload> &entry = entries[i];
+
+            if (!_notifications) {
+                _window_start_us = entry.timestamp_us;
+            } else if (entry.timestamp_us - _window_start_us >= WINDOW_US) {
+                if (_window_count > _max_rate) {
+                    _max_rate = _window_count;
+                }
+                _window_start_us = entry.timestamp_us;
+                _window_count = 0;
+            }
+
+            _notifications++;
+            _window_count++;
+            _bytes += entry.length;
+
+            uint32_t latency_us = now_us - entry.timestamp_us;
+            if (latency_us > _max_latency_us) {
+                _max_latency_us = latency_us;
+            }
+        }
+
+        _batches++;
+        if (count > _max_batch) {
+            _max_batch = count;
+        }
+    }
+
+    uint32_t notifications() const
+    {
+        return _notifications;
+    }
+
+    uint32_t bytes() const
+    {
+        return _bytes;
+    }
+
+    uint32_t batches() const
+    {
+        return _batches;
+    }
+
+    uint32_t max_batch() const
+    {
+        return _max_batch;
+    }
+
+    /** Highest number of notifications received in a window of one second */
+    uint32_t max_rate() const
+    {
+        return _window_count > _max_rate ? _window_count : _max_rate;
+    }
+
+    /** Longest time between the reception of a notification and its processing */
+    uint32_t max_latency_us() const
+    {
+        return _max_latency_us;
+    }
+
+private:
+    uint32_t _notifications = 0;
+    uint32_t _bytes = 0;
+    uint32_t _batches = 0;
+    uint32_t _max_batch = 0;
+    uint32_t _window_start_us = 0;
+    uint32_t _window_count = 0;
+    uint32_t _max_rate = 0;
+    uint32_t _max_latency_us = 0;
+};
+
+/**
+ * Decode payloads as little endian unsigned integers of up to 4 bytes.
+ */
+template<size_t MaxPayload>
+class Decoder : public Consumer<MaxPayload> {
+public:
+    virtual void consume(const entry_t<MaxPayload> *entries, size_t count, uint32_t now_us)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            const entry_t<MaxPayload> &entry = entries[i];
+            size_t length = entry.length < 4 ? entry.length : 4;
+            if (length > MaxPayload) {
+                length = MaxPayload;
+            }
+
+            uint32_t value = 0;
+            for (size_t j = 0; j < length; ++j) {
+                value |= (uint32_t)entry.data[j] << (8 * j);
+            }
+
+            _last_handle = entry.handle;
+            _last_value = value;
+            _decoded++;
+        }
+    }
+
+    uint32_t decoded() const
+    {
+        return _decoded;
+    }
+
+    uint16_t last_handle() const
+    {
+        return _last_handle;
+    }
+
+    uint32_t last_value() const
+    {
+        return _last_value;
+    }
+
+private:
+    uint32_t _decoded = 0;
+    uint16_t _last_handle = 0;
+    uint32_t _last_value = 0;
+};
+
+/**
+ * Forward batches of notifications to a function.
+ */
+template<size_t MaxPayload>
+class Forwarder : public Consumer<MaxPayload> {
+public:
+    typedef void (*forward_t)(void *context, const entry_t<MaxPayload> *entries, size_t count);
+
+    Forwarder(forward_t forward, void *context) : _forward(forward), _context(context) { }
+
+    virtual void consume(const entry_t<MaxPayload> *entries, size_t count, uint32_t now_us)
+    {
+        _forward(_context, entries, count);
+    }
+
+private:
+    forward_t _forward;
+    void *_context;
+};
+
+/**
+ * Hand the entries of a ring to a set of consumers.
+ *
+ * @return Number of notifications processed.
+ */
+template<size_t Capacity, size_t MaxPayload>
+size_t drain(Ring<Capacity, MaxPayload> &ring, Consumer<MaxPayload> **consumers, size_t consumer_count, uint32_t now_us)
+{
+    size_t processed = 0;
+
+    /* at most two spans if the ring wrapped, later entries wait for the next drain */
+    for (int span = 0; span < 2; ++span) {
+        const entry_t<MaxPayload> *entries;
+        size_t count = ring.peek(&entries);
+        if (!count) {
+            break;
+        }
+
+        for (size_t i = 0; i < consumer_count; ++i) {
+            consumers[i]->consume(entries, count, now_us);
+        }
+        ring.release(count);
+        processed += count;
+    }
+
+    return processed;
+}
+
+} // namespace notification_ring
+
+#endif // NOTIFICATION_RING_H_
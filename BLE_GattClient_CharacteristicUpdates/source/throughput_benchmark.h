@@ -0,0 +1,500 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THROUGHPUT_BENCHMARK_H_
+#define THROUGHPUT_BENCHMARK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "events/EventQueue.h"
+#include "drivers/Timer.h"
+#include "ble/BLE.h"
+#include "ble/GattClient.h"
+
+#include "throughput_meter.h"
+
+/**
+ * Measure the throughput of notifications across link settings.
+ *
+ * The benchmark drives the throughput test service of the
+ * BLE_GattServer_CharacteristicUpdates example built with
+ * throughput-service enabled. The client must be subscribed to the data
+ * characteristic of the service before the benchmark starts.
+ *
+ * For each combination of PHY, connection interval and notification payload
+ * length, the benchmark applies the PHY and the connection interval, writes
+ * the payload length to the control characteristic of the server and, after
+ * the link settles, measures the goodput and latency of the notifications
+ * received. A table of the results is printed at the end.
+ *
+ * The ATT_MTU and the data length aren't set per connection by the Mbed OS
+ * API: the ATT_MTU negotiated caps the payload lengths swept and the data
+ * length reported by the controller is printed with each result.
+ *
+ * GAP events of the connection must be forwarded to the benchmark, it must be
+ * chained with the other GAP event handlers.
+ */
+class ThroughputBenchmark : public ble::Gap::EventHandler {
+public:
+    /**
+     * Start the sweep.
+     *
+     * @param[in] ble BLE instance of the connection.
+     * @param[in] event_queue Event queue used to schedule the measures.
+     * @param[in] connection_handle Connection to the test server.
+     * @param[in] data_handle Value handle of the data characteristic.
+     * @param[in] control_handle Value handle of the control characteristic.
+     * @param[in] att_mtu ATT_MTU of the connection.
+     * @param[in] measure_time Duration of the measure of each combination.
+     * @param[in] on_complete Called once the table is printed.
+     */
+    void start(
+        BLE &ble,
+        events::EventQueue &event_queue,
+        ble::connection_handle_t connection_handle,
+        GattAttribute::Handle_t data_handle,
+        GattAttribute::Handle_t control_handle,
+        uint16_t att_mtu,
+        std::chrono::milliseconds measure_time,
+        mbed::Callback<void()> on_complete
+    )
+    {
+        _ble = &ble;
+        _event_queue = &event_queue;
+        _connection_handle = connection_handle;
+        _data_handle = data_handle;
+        _control_handle = control_handle;
+        _measure_time = measure_time;
+        _on_complete = on_complete;
+
+        _phy_count = 0;
+        _phys[_phy_count++] = ble::phy_t::LE_1M;
+        if (_ble->gap().isFeatureSupported(ble::controller_supported_features_t::LE_2M_PHY)) {
+            _phys[_phy_count++] = ble::phy_t::LE_2M;
+        }
+
+        // payloads longer than the ATT_MTU allows are capped, the ones
+        // capped to the same length are measured once
+        _payload_count = 0;
+        uint16_t max_payload = att_mtu - 3;
+        for (uint16_t payload : PAYLOADS) {
+            if (payload > max_payload) {
+                payload = max_payload;
+            }
+            if (!_payload_count || _payloads[_payload_count - 1] != payload) {
+                _payloads[_payload_count++] = payload;
+            }
+        }
+
+        _point = 0;
+        _point_count = _phy_count * INTERVAL_COUNT * _payload_count;
+        _active = true;
+        _clock.reset();
+        _clock.start();
+
+        printf(
+            "Throughput benchmark started: %u combinations measured for %d ms each.\r\n",
+            _point_count, (int) _measure_time.count()
+        );
+
+        configure_phy();
+    }
+
+    /** Abort the sweep, the connection is lost */
+    void stop()
+    {
+        if (!_active) {
+            return;
+        }
+
+        _active = false;
+        _step = STEP_IDLE;
+        _event_queue->cancel(_timeout_event);
+        _event_queue->cancel(_measure_event);
+        _timeout_event = 0;
+        _measure_event = 0;
+        _clock.stop();
+        printf("Throughput benchmark aborted after %u combinations.\r\n", _point);
+    }
+
+    /**
+     * Handle a notification.
+     *
+     * @return true if it was sent by the data characteristic.
+     */
+    bool on_hvx(const GattHVXCallbackParams *event)
+    {
+        if (event->connHandle != _connection_handle || event->handle != _data_handle) {
+            return false;
+        }
+
+        if (_step == STEP_MEASURE) {
+            _meter.on_notification(event->data, event->len, now_us());
+        }
+        return true;
+    }
+
+    /**
+     * Handle a write response.
+     *
+     * @return true if it acknowledges the write of the control characteristic.
+     */
+    bool on_data_written(const GattWriteCallbackParams *event)
+    {
+        if (event->connHandle != _connection_handle || event->handle != _control_handle) {
+            return false;
+        }
+
+        if (_step == STEP_STOP) {
+            finish();
+            return true;
+        }
+
+        if (_step != STEP_PAYLOAD) {
+            return true;
+        }
+
+        if (event->status) {
+            printf("Error: write of the payload length failed due to %u.\r\n", event->status);
+            stop();
+            return true;
+        }
+
+        // let the server fill its queues before measuring
+        _step = STEP_SETTLE;
+        _measure_event = _event_queue->call_in(SETTLE_TIME, mbed::callback(this, &ThroughputBenchmark::start_measure));
+        return true;
+    }
+
+    bool active() const
+    {
+        return _active;
+    }
+
+private:
+    enum step_t {
+        STEP_IDLE,
+        STEP_PHY,
+        STEP_INTERVAL,
+        STEP_PAYLOAD,
+        STEP_SETTLE,
+        STEP_MEASURE,
+        /* the stream is stopped, waiting for the server to acknowledge it */
+        STEP_STOP
+    };
+
+    struct row_t {
+        ble::phy_t phy;
+        /* in units of 1.25 ms */
+        uint16_t interval;
+        uint16_t payload;
+        uint16_t tx_octets;
+        uint16_t rx_octets;
+        throughput::result_t result;
+    };
+
+    static const size_t MAX_PHYS = 2;
+    static const size_t INTERVAL_COUNT = 4;
+    static const size_t PAYLOAD_COUNT = 4;
+    static const size_t MAX_POINTS = MAX_PHYS * INTERVAL_COUNT * PAYLOAD_COUNT;
+
+    /* connection intervals swept, in units of 1.25 ms: 7.5, 15, 30 and 50 ms */
+    static constexpr uint16_t INTERVALS[INTERVAL_COUNT] = { 6, 12, 24, 40 };
+    static constexpr uint16_t PAYLOADS[PAYLOAD_COUNT] = { 20, 64, 128, 244 };
+
+    /* supervision timeout of 5 s, in units of 10 ms */
+    static const uint16_t SUPERVISION_TIMEOUT = 500;
+
+    static constexpr std::chrono::milliseconds STEP_TIMEOUT = std::chrono::milliseconds(2000);
+    static constexpr std::chrono::milliseconds SETTLE_TIME = std::chrono::milliseconds(500);
+
+    ble::phy_t point_phy() const
+    {
+        return _phys[_point / (INTERVAL_COUNT * _payload_count)];
+    }
+
+    uint16_t point_interval() const
+    {
+        return INTERVALS[(_point / _payload_count) % INTERVAL_COUNT];
+    }
+
+    uint16_t point_payload() const
+    {
+        return _payloads[_point % _payload_count];
+    }
+
+    uint32_t now_us() const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(_clock.elapsed_time()).count();
+    }
+
+    /* the request is abandoned if the stack doesn't report its completion in time */
+    void arm_step_timeout()
+    {
+        _timeout_event = _event_queue->call_in(STEP_TIMEOUT, mbed::callback(this, &ThroughputBenchmark::when_step_timeout));
+    }
+
+    void when_step_timeout()
+    {
+        _timeout_event = 0;
+        if (_step == STEP_PHY) {
+            printf("PHY update to %u not completed, keep %u.\r\n", point_phy().value(), _phy.value());
+            configure_interval();
+        } else if (_step == STEP_INTERVAL) {
+            printf("Connection interval update not completed.\r\n");
+            configure_payload();
+        }
+    }
+
+    void configure_phy()
+    {
+        _step = STEP_PHY;
+        if (point_phy() == _phy) {
+            configure_interval();
+            return;
+        }
+
+        ble::phy_set_t phys(point_phy());
+        ble_error_t error = _ble->gap().setPhy(
+            _connection_handle, &phys, &phys, ble::coded_symbol_per_bit_t::UNDEFINED
+        );
+        if (error) {
+            printf("Error: cannot set the PHY due to %u.\r\n", error);
+            configure_interval();
+            return;
+        }
+        arm_step_timeout();
+    }
+
+    void configure_interval()
+    {
+        _step = STEP_INTERVAL;
+        if (point_interval() == _interval) {
+            configure_payload();
+            return;
+        }
+
+        ble_error_t error = _ble->gap().updateConnectionParameters(
+            _connection_handle,
+            ble::conn_interval_t(point_interval()),
+            ble::conn_interval_t(point_interval()),
+            ble::slave_latency_t(0),
+            ble::supervision_timeout_t(SUPERVISION_TIMEOUT)
+        );
+        if (error) {
+            printf("Error: cannot update the connection interval due to %u.\r\n", error);
+            configure_payload();
+            return;
+        }
+        arm_step_timeout();
+    }
+
+    void configure_payload()
+    {
+        _step = STEP_PAYLOAD;
+        if (write_payload_length(point_payload())) {
+            stop();
+        }
+    }
+
+    ble_error_t write_payload_length(uint16_t payload)
+    {
+        uint8_t value[2] = { (uint8_t) payload, (uint8_t) (payload >> 8) };
+        ble_error_t error = _ble->gattClient().write(
+            GattClient::GATT_OP_WRITE_REQ, _connection_handle, _control_handle, sizeof(value), value
+        );
+        if (error) {
+            printf("Error: cannot write the payload length due to %u.\r\n", error);
+        }
+        return error;
+    }
+
+    void start_measure()
+    {
+        _step = STEP_MEASURE;
+        _meter.reset(now_us());
+        _measure_event = _event_queue->call_in(_measure_time, mbed::callback(this, &ThroughputBenchmark::end_measure));
+    }
+
+    void end_measure()
+    {
+        _measure_event = 0;
+
+        row_t &row = _rows[_point];
+        row.phy = _phy;
+        row.interval = _interval;
+        row.payload = point_payload();
+        row.tx_octets = _tx_octets;
+        row.rx_octets = _rx_octets;
+        row.result = _meter.result(now_us());
+
+        printf(
+            "Combination %u/%u: %lu kbps.\r\n",
+            _point + 1, _point_count, (unsigned long) (row.result.goodput_bps() / 1000)
+        );
+
+        if (++_point < _point_count) {
+            configure_phy();
+            return;
+        }
+
+        // stop the stream, the sweep ends once the server acknowledges it
+        _step = STEP_STOP;
+        if (write_payload_length(0)) {
+            finish();
+        }
+    }
+
+    void finish()
+    {
+        _step = STEP_IDLE;
+        _active = false;
+        _clock.stop();
+
+        print_table();
+        if (_on_complete) {
+            _on_complete();
+        }
+    }
+
+    void print_table()
+    {
+        printf("PHY | interval (ms) | payload | data length tx/rx | notifications | lost | goodput (kbps) | latency mean/max (ms)\r\n");
+        for (size_t i = 0; i < _point_count; ++i) {
+            const row_t &row = _rows[i];
+            unsigned interval_us = row.interval * 1250;
+            printf(
+                "%s | %u.%02u | %u | %u/%u | %lu | %lu | %lu | %lu.%03lu/%lu.%03lu\r\n",
+                row.phy == ble::phy_t::LE_2M ? "2M" : "1M",
+                interval_us / 1000, (interval_us % 1000) / 10,
+                row.payload,
+                row.tx_octets, row.rx_octets,
+                (unsigned long) row.result.notifications,
+                (unsigned long) row.result.lost,
+                (unsigned long) (row.result.goodput_bps() / 1000),
+                (unsigned long) (row.result.mean_latency_us / 1000),
+                (unsigned long) (row.result.mean_latency_us % 1000),
+                (unsigned long) (row.result.max_latency_us / 1000),
+                (unsigned long) (row.result.max_latency_us % 1000)
+            );
+        }
+    }
+
+    /* Gap::EventHandler */
+
+    void onConnectionComplete(const ble::ConnectionCompleteEvent &event) override
+    {
+        if (event.getStatus()) {
+            return;
+        }
+
+        // default link settings until the controller reports a change
+        _phy = ble::phy_t::LE_1M;
+        _interval = event.getConnectionInterval().value();
+        _tx_octets = 27;
+        _rx_octets = 27;
+    }
+
+    void onDisconnectionComplete(const ble::DisconnectionCompleteEvent &event) override
+    {
+        if (event.getConnectionHandle() == _connection_handle) {
+            stop();
+        }
+    }
+
+    void onPhyUpdateComplete(
+        ble_error_t error,
+        ble::connection_handle_t connectionHandle,
+        ble::phy_t txPhy,
+        ble::phy_t rxPhy
+    ) override
+    {
+        if (!error) {
+            _phy = txPhy;
+        }
+
+        if (_active && _step == STEP_PHY && connectionHandle == _connection_handle) {
+            _event_queue->cancel(_timeout_event);
+            _timeout_event = 0;
+            configure_interval();
+        }
+    }
+
+    void onConnectionParametersUpdateComplete(const ble::ConnectionParametersUpdateCompleteEvent &event) override
+    {
+        if (!event.getStatus()) {
+            _interval = event.getConnectionInterval().value();
+        }
+
+        if (_active && _step == STEP_INTERVAL && event.getConnectionHandle() == _connection_handle) {
+            _event_queue->cancel(_timeout_event);
+            _timeout_event = 0;
+            configure_payload();
+        }
+    }
+
+    void onDataLengthChange(
+        ble::connection_handle_t connectionHandle,
+        uint16_t txSize,
+        uint16_t rxSize
+    ) override
+    {
+        _tx_octets = txSize;
+        _rx_octets = rxSize;
+    }
+
+private:
+    BLE *_ble = nullptr;
+    events::EventQueue *_event_queue = nullptr;
+    mbed::Callback<void()> _on_complete;
+
+    ble::connection_handle_t _connection_handle = 0;
+    GattAttribute::Handle_t _data_handle = 0;
+    GattAttribute::Handle_t _control_handle = 0;
+    std::chrono::milliseconds _measure_time;
+
+    bool _active = false;
+    step_t _step = STEP_IDLE;
+    int _timeout_event = 0;
+    int _measure_event = 0;
+
+    /* current settings of the link */
+    ble::phy_t _phy = ble::phy_t::LE_1M;
+    uint16_t _interval = 0;
+    uint16_t _tx_octets = 27;
+    uint16_t _rx_octets = 27;
+
+    /* combinations swept */
+    ble::phy_t _phys[MAX_PHYS];
+    size_t _phy_count = 0;
+    uint16_t _payloads[PAYLOAD_COUNT];
+    size_t _payload_count = 0;
+    size_t _point = 0;
+    size_t _point_count = 0;
+
+    mbed::Timer _clock;
+    throughput::Meter _meter;
+    row_t _rows[MAX_POINTS];
+};
+
+constexpr uint16_t ThroughputBenchmark::INTERVALS[];
+constexpr uint16_t ThroughputBenchmark::PAYLOADS[];
+constexpr std::chrono::milliseconds ThroughputBenchmark::STEP_TIMEOUT;
+constexpr std::chrono::milliseconds ThroughputBenchmark::SETTLE_TIME;
+
+#endif // THROUGHPUT_BENCHMARK_H_
@@ -0,0 +1,150 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THROUGHPUT_METER_H_
+#define THROUGHPUT_METER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Measure the goodput and latency of the notifications sent by the
+ * throughput test server.
+ *
+ * Each notification starts with a header of two little endian 32 bit words:
+ * a sequence number and the time it was sent in microseconds, on the clock of
+ * the server. The rest of the payload is filler.
+ *
+ * Clocks of the server and the client aren't synchronised: the latency is
+ * measured relative to the fastest notification of the window, the one with
+ * the smallest difference between the reception and the send time. It is the
+ * time notifications waited in queues on top of the best case.
+ *
+ * Nothing here depends on Mbed OS, time is passed in by the caller.
+ */
+namespace throughput {
+
+/* UUIDs of the throughput test service, see BLE_GattServer_CharacteristicUpdates */
+static const char SERVICE_UUID[] = "a4c3b200-6f3c-4b7e-9d2b-0d1f6c7e8a10";
+static const char DATA_UUID[] = "a4c3b201-6f3c-4b7e-9d2b-0d1f6c7e8a10";
+static const char CONTROL_UUID[] = "a4c3b202-6f3c-4b7e-9d2b-0d1f6c7e8a10";
+
+/* sequence number and send time */
+static const size_t HEADER_SIZE = 8;
+
+struct result_t {
+    uint32_t notifications;
+    /* payload bytes received */
+    uint32_t bytes;
+    /* notifications missing from the sequence */
+    uint32_t lost;
+    uint32_t duration_us;
+    uint32_t mean_latency_us;
+    uint32_t max_latency_us;
+
+    uint32_t goodput_bps() const
+    {
+        return duration_us ? (uint32_t) ((uint64_t) bytes * 8 * 1000000 / duration_us) : 0;
+    }
+};
+
+class Meter {
+public:
+    /** Start a new measurement window */
+    void reset(uint32_t now_us)
+    {
+        _start_us = now_us;
+        _notifications = 0;
+        _bytes = 0;
+        _lost = 0;
+        _latency_sum = 0;
+    }
+
+    /** Account a notification received */
+    void on_notification(const uint8_t *data, size_t length, uint32_t now_us)
+    {
+        _bytes += length;
+        if (length < HEADER_SIZE) {
+            _notifications++;
+            return;
+        }
+
+        uint32_t sequence = read_u32(data);
+        uint32_t sent_us = read_u32(data + 4);
+
+        // offsets are relative to the first notification of the window so
+        // they fit in 32 bits whatever the clocks are
+        uint32_t offset = now_us - sent_us;
+        if (!_notifications) {
+            _first_offset = offset;
+            _min_delta = 0;
+            _max_delta = 0;
+        } else {
+            if (sequence - _next_sequence < UINT32_MAX / 2) {
+                _lost += sequence - _next_sequence;
+            }
+            int32_t delta = (int32_t) (offset - _first_offset);
+            if (delta < _min_delta) {
+                _min_delta = delta;
+            }
+            if (delta > _max_delta) {
+                _max_delta = delta;
+            }
+            _latency_sum += delta;
+        }
+
+        _next_sequence = sequence + 1;
+        _notifications++;
+    }
+
+    result_t result(uint32_t now_us) const
+    {
+        result_t result = result_t();
+        result.notifications = _notifications;
+        result.bytes = _bytes;
+        result.lost = _lost;
+        result.duration_us = now_us - _start_us;
+
+        if (_notifications) {
+            int64_t mean_delta = _latency_sum / (int64_t) _notifications;
+            result.mean_latency_us = (uint32_t) (mean_delta - _min_delta);
+            result.max_latency_us = (uint32_t) (_max_delta - _min_delta);
+        }
+
+        return result;
+    }
+
+private:
+    static uint32_t read_u32(const uint8_t *data)
+    {
+        return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+    }
+
+    uint32_t _start_us = 0;
+    uint32_t _notifications = 0;
+    uint32_t _bytes = 0;
+    uint32_t _lost = 0;
+    uint32_t _next_sequence = 0;
+
+    uint32_t _first_offset = 0;
+    int32_t _min_delta = 0;
+    int32_t _max_delta = 0;
+    int64_t _latency_sum = 0;
+};
+
+} // namespace throughput
+
+#endif // THROUGHPUT_METER_H_
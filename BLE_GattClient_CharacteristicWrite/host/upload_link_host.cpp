@@ -0,0 +1,595 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+
+/** Run the bulk upload comparison against a simulated server on a host.
+ *
+ * The client uploads the blob as the example does with bulk-upload: write
+ * requests one at a time, then write commands and signed write commands with
+ * up to bulk-upload-credits of them handed to the stack ahead. The simulated
+ * link carries them in connection events, the simulated server acknowledges
+ * the requests in the event after the one they arrived in and checks the
+ * signature and the sign counter of the signed commands.
+ *
+ * Signed writes are really signed: an AES-CMAC with the CSRK over the
+ * attribute and the counter, as the stack computes it. The CPU time spent
+ * building and signing each write is measured on the host. On the boards
+ * Cordio computes the AES blocks of the CMAC with the HCI LE Encrypt command
+ * of the controller, which delays each signed write by a round trip per block;
+ * this delay is simulated.
+ *
+ * Results are reproducible except for the CPU times, the link has no losses.
+ */
+
+/* demo config */
+
+/* defaults of bulk-upload-size and bulk-upload-credits */
+static const uint32_t UPLOAD_SIZE = 4096;
+static const size_t UPLOAD_CREDITS = 4;
+
+/* ATT_MTU of the default configuration and of the one in mbed_app.json */
+static const uint16_t ATT_MTUS[] = { 23, 247 };
+/* in units of 1.25 ms: 7.5 and 30 ms */
+static const uint16_t INTERVALS[] = { 6, 24 };
+
+/* link layer data length and PHY (1M) */
+static const uint16_t DATA_LENGTH = 251;
+static const uint32_t BYTE_AIR_TIME_US = 8;
+
+/* time the client takes to issue a write once the previous one is reported */
+static const uint32_t HOST_LATENCY_US = 500;
+
+/* round trip of an HCI LE Encrypt command to the controller */
+static const uint32_t HCI_ENCRYPT_US = 150;
+
+/* config end */
+
+/* largest chunk written and authentication signature, as in main.cpp */
+static const uint16_t UPLOAD_MAX_CHUNK = 244;
+static const uint16_t SIGNATURE_SIZE = 12;
+
+/* interframe space */
+static const uint32_t T_IFS_US = 150;
+
+/* preamble, access address, header and CRC of a packet, in bytes */
+static const uint32_t PACKET_OVERHEAD = 1 + 4 + 2 + 3;
+
+/* L2CAP header and ATT write response */
+static const uint16_t WRITE_RESPONSE_SIZE = 4 + 1;
+
+static const uint8_t ATT_WRITE_REQ = 0x12;
+static const uint8_t ATT_WRITE_CMD = 0x52;
+static const uint8_t ATT_SIGNED_WRITE_CMD = 0xD2;
+
+static const uint16_t UPLOAD_VALUE_HANDLE = 0x0012;
+
+/* AES-128 and AES-CMAC (RFC 4493) */
+
+static const uint8_t SBOX[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static uint8_t xtime(uint8_t x)
+{
+    return (x << 1) ^ ((x & 0x80) ? 0x1b : 0x00);
+}
+
+class Aes128 {
+public:
+    explicit Aes128(const uint8_t key[16])
+    {
+        memcpy(_round_keys, key, 16);
+        uint8_t rcon = 0x01;
+        for (size_t i = 16; i < sizeof(_round_keys); i += 4) {
+            uint8_t t[4] = {
+                _round_keys[i - 4], _round_keys[i - 3], _round_keys[i - 2], _round_keys[i - 1]
+            };
+            if (i % 16 == 0) {
+                uint8_t first = t[0];
+                t[0] = SBOX[t[1]] ^ rcon;
+                t[1] = SBOX[t[2]];
+                t[2] = SBOX[t[3]];
+                t[3] = SBOX[first];
+                rcon = xtime(rcon);
+            }
+            for (size_t j = 0; j < 4; ++j) {
+                _round_keys[i + j] = _round_keys[i + j - 16] ^ t[j];
+            }
+        }
+    }
+
+    /** Encrypt a block in place */
+    void encrypt(uint8_t block[16]) const
+    {
+        add_round_key(block, 0);
+        for (size_t round = 1; round <= 10; ++round) {
+            /* SubBytes and ShiftRows */
+            uint8_t state[16];
+            for (size_t i = 0; i < 16; ++i) {
+                state[i] = SBOX[block[(i + 4 * (i % 4)) % 16]];
+            }
+            /* MixColumns, except in the last round */
+            for (size_t c = 0; c < 4; ++c) {
+                uint8_t *col = state + 4 * c;
+                if (round == 10) {
+                    break;
+                }
+                uint8_t all = col[0] ^ col[1] ^ col[2] ^ col[3];
+                uint8_t first = col[0];
+                col[0] ^= all ^ xtime(col[0] ^ col[1]);
+                col[1] ^= all ^ xtime(col[1] ^ col[2]);
+                col[2] ^= all ^ xtime(col[2] ^ col[3]);
+                col[3] ^= all ^ xtime(col[3] ^ first);
+            }
+            memcpy(block, state, 16);
+            add_round_key(block, round);
+        }
+    }
+
+private:
+    void add_round_key(uint8_t block[16], size_t round) const
+    {
+        for (size_t i = 0; i < 16; ++i) {
+            block[i] ^= _round_keys[16 * round + i];
+        }
+    }
+
+    uint8_t _round_keys[176];
+};
+
+static void shift_left(const uint8_t in[16], uint8_t out[16])
+{
+    uint8_t carry = (in[0] & 0x80) ? 0x87 : 0x00;
+    for (size_t i = 0; i < 15; ++i) {
+        out[i] = (in[i] << 1) | (in[i + 1] >> 7);
+    }
+    out[15] = (in[15] << 1) ^ carry;
+}
+
+/** AES-CMAC of a message, also counting the AES blocks computed */
+static void aes_cmac(const Aes128 &aes, const uint8_t *message, size_t length, uint8_t mac[16], uint32_t &blocks)
+{
+    uint8_t l[16] = { 0 };
+    uint8_t k1[16];
+    uint8_t k2[16];
+    aes.encrypt(l);
+    shift_left(l, k1);
+    shift_left(k1, k2);
+    blocks = 1;
+
+    size_t block_count = length ? (length + 15) / 16 : 1;
+    bool complete = length && length % 16 == 0;
+
+    uint8_t x[16] = { 0 };
+    for (size_t b = 0; b < block_count; ++b) {
+        uint8_t block[16] = { 0 };
+        size_t offset = 16 * b;
+        size_t size = length - offset < 16 ? length - offset : 16;
+        memcpy(block, message + offset, size);
+
+        if (b == block_count - 1) {
+            if (complete) {
+                for (size_t i = 0; i < 16; ++i) {
+                    block[i] ^= k1[i];
+                }
+            } else {
+                block[size] = 0x80;
+                for (size_t i = 0; i < 16; ++i) {
+                    block[i] ^= k2[i];
+                }
+            }
+        }
+
+        for (size_t i = 0; i < 16; ++i) {
+            x[i] ^= block[i];
+        }
+        aes.encrypt(x);
+        blocks++;
+    }
+
+    memcpy(mac, x, 16);
+}
+
+/** Check the implementation against the example 3 of RFC 4493 */
+static bool aes_cmac_self_test()
+{
+    static const uint8_t key[16] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+    };
+    static const uint8_t message[40] = {
+        0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+        0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+        0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11
+    };
+    static const uint8_t expected[16] = {
+        0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27
+    };
+
+    Aes128 aes(key);
+    uint8_t mac[16];
+    uint32_t blocks;
+    aes_cmac(aes, message, sizeof(message), mac, blocks);
+    return memcmp(mac, expected, sizeof(mac)) == 0;
+}
+
+/* simulated link */
+
+enum upload_method_t {
+    UPLOAD_WRITE_REQUEST,
+    UPLOAD_WRITE_COMMAND,
+    UPLOAD_SIGNED_WRITE_COMMAND,
+    UPLOAD_DONE
+};
+
+static const char *const METHOD_NAMES[] = { "write requests", "write commands", "signed write commands" };
+
+/* key distributed while bonding, shared by both sides */
+static const uint8_t CSRK[16] = {
+    0x4c, 0x3a, 0x12, 0x9e, 0x01, 0x7d, 0xb0, 0x55, 0xe2, 0x68, 0x9f, 0x0c, 0x31, 0xa4, 0xd7, 0x86
+};
+
+/**
+ * Message signed by a signed write: opcode, handle, value and sign counter.
+ *
+ * The Bluetooth signature reverses the byte order of the message and of the
+ * key for the CMAC, it isn't reproduced, it costs the same.
+ */
+static size_t build_signed_message(uint8_t *message, const uint8_t *pdu, size_t pdu_length, uint32_t counter)
+{
+    memcpy(message, pdu, pdu_length);
+    message[pdu_length] = counter;
+    message[pdu_length + 1] = counter >> 8;
+    message[pdu_length + 2] = counter >> 16;
+    message[pdu_length + 3] = counter >> 24;
+    return pdu_length + 4;
+}
+
+/** Server of the upload characteristic, checking what it receives */
+class SimulatedServer {
+public:
+    SimulatedServer() : _aes(CSRK) {}
+
+    void reset()
+    {
+        _received = 0;
+        _rejected = 0;
+        _last_counter = 0;
+        _counter_seen = false;
+    }
+
+    /** Receive a write PDU, the content of the blob is a byte counter */
+    void on_pdu(const uint8_t *pdu, size_t length)
+    {
+        size_t value_length = length - 3;
+        if (pdu[0] == ATT_SIGNED_WRITE_CMD) {
+            value_length -= SIGNATURE_SIZE;
+
+            uint8_t message[3 + UPLOAD_MAX_CHUNK + 4];
+            const uint8_t *signature = pdu + 3 + value_length;
+            uint32_t counter = signature[0] | (signature[1] << 8) | (signature[2] << 16) | ((uint32_t) signature[3] << 24);
+            size_t message_length = build_signed_message(message, pdu, 3 + value_length, counter);
+
+            uint8_t mac[16];
+            uint32_t blocks;
+            aes_cmac(_aes, message, message_length, mac, blocks);
+
+            /* the signature carries the 64 most significant bits of the MAC,
+             * a counter not greater than the last one is a replay */
+            if (memcmp(signature + 4, mac, 8) != 0 || (_counter_seen && counter <= _last_counter)) {
+                _rejected++;
+                return;
+            }
+            _last_counter = counter;
+            _counter_seen = true;
+        }
+
+        for (size_t i = 0; i < value_length; ++i) {
+            if (pdu[3 + i] != (uint8_t) (_received + i)) {
+                _rejected++;
+                return;
+            }
+        }
+        _received += value_length;
+    }
+
+    uint32_t received() const
+    {
+        return _received;
+    }
+
+    uint32_t rejected() const
+    {
+        return _rejected;
+    }
+
+private:
+    Aes128 _aes;
+    uint32_t _received = 0;
+    uint32_t _rejected = 0;
+    uint32_t _last_counter = 0;
+    bool _counter_seen = false;
+};
+
+struct result_t {
+    uint32_t duration_us;
+    uint32_t writes;
+    uint64_t latency_sum_us;
+    uint32_t latency_max_us;
+    /* measured on the host */
+    uint64_t cpu_ns;
+    uint32_t received;
+    uint32_t rejected;
+};
+
+/** Client uploading the blob over the simulated link */
+class SimulatedUpload {
+public:
+    SimulatedUpload(upload_method_t method, uint16_t att_mtu, uint16_t interval, SimulatedServer &server) :
+        _method(method),
+        _att_mtu(att_mtu),
+        _interval_us(interval * 1250),
+        _server(server),
+        _aes(CSRK)
+    {
+    }
+
+    result_t run()
+    {
+        _server.reset();
+        issue(0);
+
+        uint32_t anchor_us = 0;
+        /* the response to a write request is sent in the event after the request */
+        bool response_due = false;
+        uint32_t request_sent_us = 0;
+
+        while (_offset < UPLOAD_SIZE || _queued || response_due) {
+            uint32_t now_us = anchor_us;
+            uint32_t event_end_us = anchor_us + _interval_us;
+            size_t completed = 0;
+
+            if (response_due) {
+                /* empty packet of the client, response of the server */
+                now_us += empty_packet_us() + T_IFS_US + packet_us(WRITE_RESPONSE_SIZE) + T_IFS_US;
+                response_due = false;
+                complete(request_sent_us, now_us);
+                issue(now_us + HOST_LATENCY_US);
+            }
+
+            while (_queued && !response_due) {
+                write_t &head = _queue[_head];
+                uint16_t length = head.pdu_length + 4;
+                uint16_t fragment = length < DATA_LENGTH ? length : DATA_LENGTH;
+                uint32_t exchange_us = packet_us(fragment) + T_IFS_US + empty_packet_us() + T_IFS_US;
+
+                /* still being signed, or the event closes before the next anchor */
+                if (head.ready_us > now_us || now_us + exchange_us > event_end_us) {
+                    break;
+                }
+                now_us += exchange_us;
+
+                /* a PDU longer than the data length is sent in the next exchanges */
+                head.left = (head.left ? head.left : length) - fragment;
+                if (head.left) {
+                    continue;
+                }
+
+                _server.on_pdu(head.pdu, head.pdu_length);
+                _head = (_head + 1) % UPLOAD_CREDITS;
+                _queued--;
+
+                if (_method == UPLOAD_WRITE_REQUEST) {
+                    response_due = true;
+                    request_sent_us = head.issued_us;
+                } else {
+                    completed++;
+                    _completion_times[completed - 1] = head.issued_us;
+                }
+            }
+
+            /* the stack reports the commands sent at the end of the event, each one returns a credit */
+            if (completed) {
+                for (size_t i = 0; i < completed; ++i) {
+                    complete(_completion_times[i], now_us);
+                }
+                issue(now_us + HOST_LATENCY_US);
+            }
+
+            anchor_us += _interval_us;
+        }
+
+        _result.received = _server.received();
+        _result.rejected = _server.rejected();
+        return _result;
+    }
+
+private:
+    struct write_t {
+        uint8_t pdu[3 + UPLOAD_MAX_CHUNK + SIGNATURE_SIZE];
+        uint16_t pdu_length;
+        uint32_t issued_us;
+        /* time the PDU is handed to the controller, once signed */
+        uint32_t ready_us;
+        /* bytes left to send of a PDU split in packets */
+        uint16_t left;
+    };
+
+    uint32_t packet_us(uint32_t payload) const
+    {
+        return (PACKET_OVERHEAD + payload) * BYTE_AIR_TIME_US;
+    }
+
+    uint32_t empty_packet_us() const
+    {
+        return packet_us(0);
+    }
+
+    /** Queue writes while credits are left, as upload() in main.cpp */
+    void issue(uint32_t now_us)
+    {
+        const size_t credits = _method == UPLOAD_WRITE_REQUEST ? 1 : UPLOAD_CREDITS;
+
+        while (_offset < UPLOAD_SIZE && _queued < credits) {
+            uint16_t length = _att_mtu - 3;
+            if (_method == UPLOAD_SIGNED_WRITE_COMMAND) {
+                length -= SIGNATURE_SIZE;
+            }
+            if (length > UPLOAD_MAX_CHUNK) {
+                length = UPLOAD_MAX_CHUNK;
+            }
+            if (length > UPLOAD_SIZE - _offset) {
+                length = UPLOAD_SIZE - _offset;
+            }
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            write_t &write = _queue[(_head + _queued) % UPLOAD_CREDITS];
+            static const uint8_t opcodes[] = { ATT_WRITE_REQ, ATT_WRITE_CMD, ATT_SIGNED_WRITE_CMD };
+            write.pdu[0] = opcodes[_method];
+            write.pdu[1] = UPLOAD_VALUE_HANDLE;
+            write.pdu[2] = UPLOAD_VALUE_HANDLE >> 8;
+            for (uint16_t i = 0; i < length; ++i) {
+                write.pdu[3 + i] = _offset + i;
+            }
+            write.pdu_length = 3 + length;
+            write.issued_us = now_us;
+            write.ready_us = now_us;
+            write.left = 0;
+
+            if (_method == UPLOAD_SIGNED_WRITE_COMMAND) {
+                uint32_t blocks = sign(write);
+                /* the AES blocks go through the controller one after the
+                 * other, and the writes are signed in turn */
+                if (_signing_done_us > write.ready_us) {
+                    write.ready_us = _signing_done_us;
+                }
+                write.ready_us += blocks * HCI_ENCRYPT_US;
+                _signing_done_us = write.ready_us;
+            }
+
+            _result.cpu_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start
+            ).count();
+
+            _offset += length;
+            _queued++;
+            _result.writes++;
+        }
+    }
+
+    /** Append the sign counter and the MAC to a write, return the AES blocks computed */
+    uint32_t sign(write_t &write)
+    {
+        uint8_t message[3 + UPLOAD_MAX_CHUNK + 4];
+        size_t message_length = build_signed_message(message, write.pdu, write.pdu_length, _sign_counter);
+
+        uint8_t mac[16];
+        uint32_t blocks;
+        aes_cmac(_aes, message, message_length, mac, blocks);
+
+        memcpy(write.pdu + write.pdu_length, message + write.pdu_length, 4);
+        memcpy(write.pdu + write.pdu_length + 4, mac, 8);
+        write.pdu_length += SIGNATURE_SIZE;
+        _sign_counter++;
+        return blocks;
+    }
+
+    void complete(uint32_t issued_us, uint32_t now_us)
+    {
+        /* the upload ends with its last write */
+        _result.duration_us = now_us;
+
+        uint32_t latency_us = now_us - issued_us;
+        _result.latency_sum_us += latency_us;
+        if (latency_us > _result.latency_max_us) {
+            _result.latency_max_us = latency_us;
+        }
+    }
+
+    upload_method_t _method;
+    uint16_t _att_mtu;
+    uint32_t _interval_us;
+    SimulatedServer &_server;
+    Aes128 _aes;
+
+    uint32_t _offset = 0;
+    uint32_t _sign_counter = 0;
+    uint32_t _signing_done_us = 0;
+
+    write_t _queue[UPLOAD_CREDITS];
+    uint32_t _completion_times[UPLOAD_CREDITS];
+    size_t _head = 0;
+    size_t _queued = 0;
+
+    result_t _result = result_t();
+};
+
+int main()
+{
+    if (!aes_cmac_self_test()) {
+        printf("AES-CMAC doesn't match RFC 4493, signatures are meaningless\r\n");
+        return 1;
+    }
+
+    SimulatedServer server;
+
+    printf("ATT_MTU | interval (ms) | method | bytes/s | writes | latency mean/max (us) | CPU per write (ns) | received | rejected\r\n");
+
+    for (uint16_t att_mtu : ATT_MTUS) {
+        for (uint16_t interval : INTERVALS) {
+            for (size_t method = UPLOAD_WRITE_REQUEST; method < UPLOAD_DONE; ++method) {
+                SimulatedUpload upload(static_cast<upload_method_t>(method), att_mtu, interval, server);
+                result_t result = upload.run();
+
+                unsigned interval_us = interval * 1250;
+                printf(
+                    "%u | %u.%02u | %s | %lu | %lu | %lu/%lu | %lu | %lu | %lu\r\n",
+                    att_mtu,
+                    interval_us / 1000, (interval_us % 1000) / 10,
+                    METHOD_NAMES[method],
+                    result.duration_us ? (unsigned long) ((uint64_t) UPLOAD_SIZE * 1000000 / result.duration_us) : 0UL,
+                    (unsigned long) result.writes,
+                    result.writes ? (unsigned long) (result.latency_sum_us / result.writes) : 0UL,
+                    (unsigned long) result.latency_max_us,
+                    result.writes ? (unsigned long) (result.cpu_ns / result.writes) : 0UL,
+                    (unsigned long) result.received,
+                    (unsigned long) result.rejected
+                );
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,272 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GATT_COALESCING_WRITER_H_
+#define GATT_COALESCING_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ble/BLE.h"
+#include "ble/GattClient.h"
+
+/**
+ * Write request queue keeping only the latest value of each attribute.
+ *
+ * A single write request can be outstanding on the ATT bearer. Values
+ * submitted while it is busy wait in a slot of their attribute; a newer value
+ * for the same attribute replaces the one waiting, which is counted as
+ * coalesced. Once the bearer is free the slots waiting are written in turn,
+ * so a fast changing attribute can't starve the others.
+ *
+ * The staleness of a value is the time from its submission to the
+ * acknowledgement of its write.
+ *
+ * Time is passed in by the caller, in microseconds. Write responses must be
+ * forwarded to on_data_written().
+ *
+ * @tparam Handles Maximum number of attributes written.
+ * @tparam MaxValueLength Maximum length of a value.
+ */
+template<size_t Handles, size_t MaxValueLength>
+class GattCoalescingWriter {
+public:
+    struct stats_t {
+        /* values submitted */
+        uint32_t submitted;
+        /* values written */
+        uint32_t written;
+        /* values replaced by a newer one before being written */
+        uint32_t coalesced;
+        /* writes refused by the stack or the server */
+        uint32_t failed;
+        /* writes refused by a busy stack and retried */
+        uint32_t retries;
+        uint64_t staleness_sum_us;
+        uint32_t max_staleness_us;
+
+        uint32_t mean_staleness_us() const
+        {
+            return written ? (uint32_t) (staleness_sum_us / written) : 0;
+        }
+    };
+
+    /**
+     * Use the writer on a connection, the values waiting are dropped.
+     */
+    void reset(GattClient *client, ble::connection_handle_t connection_handle)
+    {
+        _client = client;
+        _connection_handle = connection_handle;
+        _slot_count = 0;
+        _next = 0;
+        _in_flight = nullptr;
+        _stats = stats_t();
+    }
+
+    /**
+     * Submit the new value of an attribute.
+     *
+     * @return BLE_ERROR_NO_MEM if no slot is left for a new attribute,
+     * BLE_ERROR_INVALID_PARAM if the value is too long.
+     */
+    ble_error_t write(GattAttribute::Handle_t handle, const uint8_t *value, uint16_t length, uint32_t now_us)
+    {
+        if (length > MaxValueLength) {
+            return BLE_ERROR_INVALID_PARAM;
+        }
+
+        slot_t *slot = find(handle);
+        if (!slot) {
+            if (_slot_count == Handles) {
+                return BLE_ERROR_NO_MEM;
+            }
+            slot = &_slots[_slot_count++];
+            slot->handle = handle;
+            slot->pending = false;
+        }
+
+        if (slot->pending) {
+            _stats.coalesced++;
+        }
+
+        memcpy(slot->value, value, length);
+        slot->length = length;
+        slot->submitted_us = now_us;
+        slot->pending = true;
+        _stats.submitted++;
+
+        send();
+        return BLE_ERROR_NONE;
+    }
+
+    /**
+     * Handle a write response.
+     *
+     * @return true if the response belongs to the write in flight.
+     */
+    bool on_data_written(const GattWriteCallbackParams *event, uint32_t now_us)
+    {
+        if (!_in_flight ||
+            event->connHandle != _connection_handle ||
+            event->handle != _in_flight->handle
+        ) {
+            return false;
+        }
+
+        _in_flight = nullptr;
+
+        if (event->status) {
+            _stats.failed++;
+        } else {
+            uint32_t staleness_us = now_us - _in_flight_submitted_us;
+            _stats.written++;
+            _stats.staleness_sum_us += staleness_us;
+            if (staleness_us > _stats.max_staleness_us) {
+                _stats.max_staleness_us = staleness_us;
+            }
+        }
+
+        send();
+        return true;
+    }
+
+    /**
+     * Write the next value waiting, after the stack refused it.
+     *
+     * @return true if values are still waiting for the stack.
+     */
+    bool retry()
+    {
+        send();
+        return stalled();
+    }
+
+    /** Values are waiting while nothing is in flight */
+    bool stalled() const
+    {
+        return !_in_flight && pending();
+    }
+
+    /** Values are waiting to be written */
+    bool pending() const
+    {
+        for (size_t i = 0; i < _slot_count; ++i) {
+            if (_slots[i].pending) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** Nothing is waiting nor in flight */
+    bool idle() const
+    {
+        return !_in_flight && !pending();
+    }
+
+    const stats_t &stats() const
+    {
+        return _stats;
+    }
+
+private:
+    struct slot_t {
+        GattAttribute::Handle_t handle;
+        bool pending;
+        uint16_t length;
+        uint32_t submitted_us;
+        uint8_t value[MaxValueLength];
+    };
+
+    slot_t *find(GattAttribute::Handle_t handle)
+    {
+        for (size_t i = 0; i < _slot_count; ++i) {
+            if (_slots[i].handle == handle) {
+                return &_slots[i];
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Write the next slot waiting if the bearer is free, slots are visited
+     * in turn starting after the last one written.
+     */
+    void send()
+    {
+        if (!_client) {
+            return;
+        }
+
+        slot_t *slot;
+        while (!_in_flight && (slot = next_pending())) {
+            ble_error_t error = _client->write(
+                GattClient::GATT_OP_WRITE_REQ,
+                _connection_handle,
+                slot->handle,
+                slot->length,
+                slot->value
+            );
+
+            if (error == BLE_STACK_BUSY) {
+                _stats.retries++;
+                return;
+            }
+
+            // the value is copied by the stack, the slot is free for the next one
+            slot->pending = false;
+            _next = (slot - _slots + 1) % _slot_count;
+
+            if (error) {
+                // no response will come, the scan restarts after this slot
+                _stats.failed++;
+                continue;
+            }
+
+            _in_flight = slot;
+            _in_flight_submitted_us = slot->submitted_us;
+        }
+    }
+
+    /** First slot waiting, starting from _next */
+    slot_t *next_pending()
+    {
+        for (size_t n = 0; n < _slot_count; ++n) {
+            slot_t &slot = _slots[(_next + n) % _slot_count];
+            if (slot.pending) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    GattClient *_client = nullptr;
+    ble::connection_handle_t _connection_handle = 0;
+
+    size_t _slot_count = 0;
+    /* slot visited first by the next write */
+    size_t _next = 0;
+    slot_t _slots[Handles];
+
+    const slot_t *_in_flight = nullptr;
+    uint32_t _in_flight_submitted_us = 0;
+
+    stats_t _stats = stats_t();
+};
+
+#endif // GATT_COALESCING_WRITER_H_
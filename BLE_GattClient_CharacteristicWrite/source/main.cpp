@@ -15,8 +15,10 @@
  */
 
 #include "events/mbed_events.h"
+#include "drivers/Timer.h"
 #include "ble/BLE.h"
 #include "ble_app.h"
+#include "gatt_coalescing_writer.h"
 #include "mbed-trace/mbed_trace.h"
 
 /* GATT server needs free functions */
@@ -26,9 +28,59 @@ void discovery_termination(ble::connection_handle_t connectionHandle);
 void on_read(const GattReadCallbackParams *response);
 void on_write(const GattWriteCallbackParams *response);
 
-class GattClientDemo : public ble::Gap::EventHandler {
+using namespace std::chrono;
+
+#if MBED_CONF_APP_COALESCING_WRITES && MBED_CONF_APP_BULK_UPLOAD
+#error "coalescing-writes is a different session than bulk-upload, enable only one of them"
+#endif
+
+#if MBED_CONF_APP_COALESCING_WRITES
+/* period of the updates of the value, shorter than the round trip of a write request */
+static const milliseconds COALESCING_UPDATE_PERIOD = milliseconds(MBED_CONF_APP_COALESCING_UPDATE_PERIOD_MS);
+#endif // MBED_CONF_APP_COALESCING_WRITES
+
+#if MBED_CONF_APP_BULK_UPLOAD && MBED_CONF_APP_KEEP_ALIVE
+#error "keep-alive reconnects to the writable characteristic, disable bulk-upload"
+#endif
+
+#if MBED_CONF_APP_KEEP_ALIVE
+/* time between two sessions, like the sleep of main() */
+static const milliseconds KEEP_ALIVE_PERIOD = 5000ms;
+#endif // MBED_CONF_APP_KEEP_ALIVE
+
+#if MBED_CONF_APP_BULK_UPLOAD || MBED_CONF_APP_COALESCING_WRITES
+/* delay before retrying a write refused by the stack when none is in flight */
+static const milliseconds BUSY_RETRY_DELAY = 10ms;
+#endif // MBED_CONF_APP_BULK_UPLOAD || MBED_CONF_APP_COALESCING_WRITES
+
+class GattClientDemo : public ble::Gap::EventHandler,
+#if MBED_CONF_APP_BULK_UPLOAD
+                       public SecurityManager::EventHandler,
+#endif // MBED_CONF_APP_BULK_UPLOAD
+                       public GattClient::EventHandler {
     const static uint16_t EXAMPLE_SERVICE_UUID         = 0xA000;
     const static uint16_t WRITABLE_CHARACTERISTIC_UUID = 0xA001;
+#if MBED_CONF_APP_BULK_UPLOAD
+    const static uint16_t UPLOAD_CHARACTERISTIC_UUID   = 0xA002;
+
+    /* largest chunk written, the payload of an ATT packet filling a 251 byte data length */
+    const static uint16_t UPLOAD_MAX_CHUNK = 244;
+    /* authentication signature appended to a signed write command */
+    const static uint16_t SIGNATURE_SIZE = 12;
+
+    /* write methods compared, in the order they are used */
+    enum upload_method_t {
+        UPLOAD_WRITE_REQUEST,
+        UPLOAD_WRITE_COMMAND,
+        UPLOAD_SIGNED_WRITE_COMMAND,
+        UPLOAD_DONE
+    };
+#endif // MBED_CONF_APP_BULK_UPLOAD
+
+#if MBED_CONF_APP_COALESCING_WRITES
+    /* only the writable characteristic is written */
+    typedef GattCoalescingWriter<1, 1> CoalescingWriter;
+#endif // MBED_CONF_APP_COALESCING_WRITES
 
     friend void service_discovery(const DiscoveredService *service);
     friend void characteristic_discovery(const DiscoveredCharacteristic *characteristic);
@@ -43,6 +95,20 @@ public:
     }
 
     void start() {
+#if MBED_CONF_APP_KEEP_ALIVE
+        /* the peer is found again by the scan of the new stack */
+        _peer_known = false;
+        _cycle_reconnected = false;
+        _cycle_timer.reset();
+        _cycle_timer.start();
+#endif // MBED_CONF_APP_KEEP_ALIVE
+
+#if MBED_CONF_APP_BULK_UPLOAD
+        /* bonds are lost with the stack */
+        _upload_bonded = false;
+        _upload_reconnecting = false;
+#endif // MBED_CONF_APP_BULK_UPLOAD
+
         _ble_app.add_gap_event_handler(this);
         _ble_app.set_target_name("GattServer");
 
@@ -58,11 +124,72 @@ private:
         _event_queue = &event_queue;
         _ble->gattClient().onDataRead(::on_read);
         _ble->gattClient().onDataWritten(::on_write);
+        _ble->gattClient().setEventHandler(this);
+
+#if MBED_CONF_APP_BULK_UPLOAD
+        /* signed writes need a CSRK, the keys distributed while bonding include it */
+        ble_error_t error = _ble->securityManager().init(
+            /* enableBonding */ true,
+            /* requireMITM */ false,
+            /* iocaps */ SecurityManager::IO_CAPS_NONE,
+            /* passkey */ nullptr,
+            /* signing */ true
+        );
+        if (error) {
+            printf("Security manager initialisation failed with error %u\r\n", error);
+        }
+        _ble->securityManager().setSecurityManagerEventHandler(this);
+
+        /* the stack signs writes while processing its events, they are timed */
+        _ble->onEventsToProcess(makeFunctionPointer(this, &GattClientDemo::schedule_ble_events));
+#endif // MBED_CONF_APP_BULK_UPLOAD
     }
 
     void onConnectionComplete(const ble::ConnectionCompleteEvent &event) {
+        _att_mtu = 23;
+
+#if MBED_CONF_APP_KEEP_ALIVE || MBED_CONF_APP_BULK_UPLOAD
+        if (event.getStatus() != BLE_ERROR_NONE) {
+            printf("Connection failed with error %u, restart the stack\r\n", event.getStatus());
+            _ble_app.stop();
+            return;
+        }
+
+        /* remembered to reconnect without scanning */
+        _connection_handle = event.getConnectionHandle();
+        _peer_address_type = event.getPeerAddressType();
+        _peer_address = event.getPeerAddress();
+        _connection_interval = event.getConnectionInterval();
+        _connection_latency = event.getConnectionLatency();
+        _supervision_timeout = event.getSupervisionTimeout();
+#endif // MBED_CONF_APP_KEEP_ALIVE || MBED_CONF_APP_BULK_UPLOAD
+
+#if MBED_CONF_APP_KEEP_ALIVE
+        if (_peer_known) {
+            /* the server is the same, its value handle didn't change */
+            printf("Reconnected, reading the value at handle %u\r\n", writable_characteristic.getValueHandle());
+            _ble->gattClient().read(_connection_handle, writable_characteristic.getValueHandle(), 0);
+            return;
+        }
+#endif // MBED_CONF_APP_KEEP_ALIVE
+
+#if MBED_CONF_APP_BULK_UPLOAD
+        if (_upload_reconnecting) {
+            /* the upload characteristic is known, the signed writes start once the ATT_MTU is set again */
+            printf("Reconnected without encryption, negotiating the ATT_MTU\r\n");
+            _ble->gattClient().negotiateAttMtu(_connection_handle);
+            return;
+        }
+
+        printf("We are looking for a service with UUID 0xA000\r\n");
+        printf("And a characteristic with UUID 0xA002 to upload %u bytes to\r\n", MBED_CONF_APP_BULK_UPLOAD_SIZE);
+
+        /* chunks are as large as the ATT_MTU allows */
+        _ble->gattClient().negotiateAttMtu(event.getConnectionHandle());
+#else
         printf("We are looking for a service with UUID 0xA000\r\n");
         printf("And a characteristic with UUID 0xA001\r\n");
+#endif // MBED_CONF_APP_BULK_UPLOAD
 
         _ble->gattClient().onServiceDiscoveryTermination(::discovery_termination);
         _ble->gattClient().launchServiceDiscovery(
@@ -70,10 +197,26 @@ private:
             ::service_discovery,
             ::characteristic_discovery,
             EXAMPLE_SERVICE_UUID,
+#if MBED_CONF_APP_BULK_UPLOAD
+            UPLOAD_CHARACTERISTIC_UUID
+#else
             WRITABLE_CHARACTERISTIC_UUID
+#endif // MBED_CONF_APP_BULK_UPLOAD
         );
     }
 
+    void onAttMtuChange(ble::connection_handle_t connectionHandle, uint16_t attMtuSize) override {
+        printf("ATT_MTU changed to %u\r\n", attMtuSize);
+        _att_mtu = attMtuSize;
+
+#if MBED_CONF_APP_BULK_UPLOAD
+        if (_upload_reconnecting) {
+            _upload_reconnecting = false;
+            _event_queue->call([this]{ start_upload(UPLOAD_SIGNED_WRITE_COMMAND); });
+        }
+#endif // MBED_CONF_APP_BULK_UPLOAD
+    }
+
 private:
     void service_discovery(const DiscoveredService *service) {
         if (service->getUUID().shortOrLong() == UUID::UUID_TYPE_SHORT) {
@@ -84,18 +227,36 @@ private:
     }
 
     void characteristic_discovery(const DiscoveredCharacteristic *characteristic) {
+#if MBED_CONF_APP_BULK_UPLOAD
+        if (characteristic->getUUID().getShortUUID() == UPLOAD_CHARACTERISTIC_UUID) {
+            printf("We found the characteristic we were looking for\r\n");
+            upload_characteristic = *characteristic;
+            upload_characteristic_found = true;
+        }
+#else
         if (characteristic->getUUID().getShortUUID() == WRITABLE_CHARACTERISTIC_UUID) {
             printf("We found the characteristic we were looking for\r\n");
             writable_characteristic = *characteristic;
             writable_characteristic_found = true;
         }
+#endif // MBED_CONF_APP_BULK_UPLOAD
     }
 
     void discovery_termination(ble::connection_handle_t connectionHandle) {
+#if MBED_CONF_APP_BULK_UPLOAD
+        if (upload_characteristic_found) {
+            upload_characteristic_found = false;
+            _event_queue->call([this]{ start_upload(UPLOAD_WRITE_REQUEST); });
+        }
+#else
         if (writable_characteristic_found) {
             writable_characteristic_found = false;
+#if MBED_CONF_APP_KEEP_ALIVE
+            _peer_known = true;
+#endif // MBED_CONF_APP_KEEP_ALIVE
             _event_queue->call([this]{ writable_characteristic.read(); });
         }
+#endif // MBED_CONF_APP_BULK_UPLOAD
     }
 
     void on_read(const GattReadCallbackParams *response) {
@@ -104,20 +265,461 @@ private:
             uint8_t value = response->data[0];
             value++;
 
-            /* and write it back */
-            writable_characteristic.write(1, &value);
+#if MBED_CONF_APP_COALESCING_WRITES
+            /* and keep writing it back while it changes faster than it can be written */
+            start_coalescing_writes(response->connHandle, value);
+#else
+            /* and write it back, on the connection the value was read from */
+            _ble->gattClient().write(
+                GattClient::GATT_OP_WRITE_REQ,
+                response->connHandle,
+                response->handle,
+                1,
+                &value
+            );
 
             printf("Written new value of %x\r\n", value);
+#endif // MBED_CONF_APP_COALESCING_WRITES
         }
     }
 
     void on_write(const GattWriteCallbackParams *response) {
+#if MBED_CONF_APP_COALESCING_WRITES
+        if (_coalescing_writer.on_data_written(response, now_us())) {
+            retry_coalesced_writes();
+            return;
+        }
+#endif // MBED_CONF_APP_COALESCING_WRITES
+
+#if MBED_CONF_APP_BULK_UPLOAD
+        if (response->handle == upload_characteristic.getValueHandle()) {
+            when_upload_written(response);
+        }
+#else
         if (response->handle == writable_characteristic.getValueHandle()) {
+            end_session();
+        }
+#endif // MBED_CONF_APP_BULK_UPLOAD
+    }
+
+    /**
+     * Conclude the session once the value is written.
+     */
+    void end_session() {
+#if MBED_CONF_APP_KEEP_ALIVE
+        _cycle_timer.stop();
+        printf(
+            "Cycle %u: value written %d ms after wake up (%s)\r\n",
+            _cycle,
+            (int) duration_cast<milliseconds>(_cycle_timer.elapsed_time()).count(),
+            _cycle_reconnected ? "reconnection" : "stack initialisation and discovery"
+        );
+        _cycle++;
+
+        /* the stack stays up, the link is dropped until the next session */
+        _ble->gap().disconnect(_connection_handle, ble::local_disconnection_reason_t::USER_TERMINATION);
+#else
+        /* this concludes the example, we stop the app running the ble process in the background */
+        _ble_app.stop();
+#endif // MBED_CONF_APP_KEEP_ALIVE
+    }
+
+#if MBED_CONF_APP_KEEP_ALIVE
+    void onDisconnectionComplete(const ble::DisconnectionCompleteEvent &event) {
+        if (!_peer_known) {
+            return;
+        }
+
+        /* BLEApp scans again once disconnected, the peer is reconnected directly instead */
+        _event_queue->call([this]{ _ble->gap().stopScan(); });
+        _event_queue->call_in(KEEP_ALIVE_PERIOD, [this]{ reconnect(); });
+    }
+
+    void reconnect() {
+        _cycle_timer.reset();
+        _cycle_timer.start();
+        _cycle_reconnected = true;
+
+        connect_to_peer();
+    }
+#endif // MBED_CONF_APP_KEEP_ALIVE
+
+#if MBED_CONF_APP_KEEP_ALIVE || MBED_CONF_APP_BULK_UPLOAD
+    /**
+     * Connect to the last peer with the parameters of the last connection.
+     */
+    void connect_to_peer() {
+        _ble->gap().stopScan();
+
+        ble::ConnectionParameters connection_params;
+        connection_params.setConnectionParameters(
+            _connection_interval,
+            _connection_interval,
+            _connection_latency,
+            _supervision_timeout
+        );
+
+        ble_error_t error = _ble->gap().connect(_peer_address_type, _peer_address, connection_params);
+        if (error) {
+            printf("Reconnection failed with error %u, restart the stack\r\n", error);
+            _ble_app.stop();
+        }
+    }
+#endif // MBED_CONF_APP_KEEP_ALIVE || MBED_CONF_APP_BULK_UPLOAD
+
+#if MBED_CONF_APP_COALESCING_WRITES
+private:
+    /**
+     * Update the value every COALESCING_UPDATE_PERIOD and write each update.
+     *
+     * Updates come faster than write requests complete, the coalescing
+     * writer only keeps the latest one while a write is in flight.
+     */
+    void start_coalescing_writes(ble::connection_handle_t connection_handle, uint8_t value) {
+        _coalescing_writer.reset(&_ble->gattClient(), connection_handle);
+        _coalescing_value = value;
+        _coalescing_updates = 0;
+        _coalescing_clock.reset();
+        _coalescing_clock.start();
+
+        printf(
+            "Updating the value %u times every %d ms\r\n",
+            MBED_CONF_APP_COALESCING_UPDATES,
+            (int) COALESCING_UPDATE_PERIOD.count()
+        );
+
+        update_coalesced_value();
+        _coalescing_event = _event_queue->call_every(
+            COALESCING_UPDATE_PERIOD,
+            [this]{ update_coalesced_value(); }
+        );
+    }
+
+    void update_coalesced_value() {
+        if (_coalescing_updates == MBED_CONF_APP_COALESCING_UPDATES) {
+            return;
+        }
+
+        _coalescing_writer.write(writable_characteristic.getValueHandle(), &_coalescing_value, 1, now_us());
+        _coalescing_value++;
+        _coalescing_updates++;
+
+        if (_coalescing_updates == MBED_CONF_APP_COALESCING_UPDATES) {
+            _event_queue->cancel(_coalescing_event);
+            _coalescing_event = 0;
+        }
+
+        retry_coalesced_writes();
+    }
+
+    /**
+     * Issue the write the stack refused, until it accepts it, and conclude
+     * once the last update is written.
+     *
+     * A write failing synchronously gets no response, the writer may become
+     * idle after an update rather than after a response.
+     */
+    void retry_coalesced_writes() {
+        if (_coalescing_writer.stalled() && _coalescing_writer.retry()) {
+            if (!_coalescing_retry_event) {
+                _coalescing_retry_event = _event_queue->call_in(BUSY_RETRY_DELAY, [this]{
+                    _coalescing_retry_event = 0;
+                    retry_coalesced_writes();
+                });
+            }
+            return;
+        }
+
+        if (_coalescing_updates == MBED_CONF_APP_COALESCING_UPDATES && _coalescing_writer.idle()) {
+            end_coalescing_writes();
+        }
+    }
+
+    void end_coalescing_writes() {
+        if (_coalescing_retry_event) {
+            _event_queue->cancel(_coalescing_retry_event);
+            _coalescing_retry_event = 0;
+        }
+
+        const CoalescingWriter::stats_t &stats = _coalescing_writer.stats();
+        printf(
+            "Coalescing writes: %lu values submitted, %lu written, %lu coalesced, %lu failed, %lu retries\r\n",
+            (unsigned long) stats.submitted,
+            (unsigned long) stats.written,
+            (unsigned long) stats.coalesced,
+            (unsigned long) stats.failed,
+            (unsigned long) stats.retries
+        );
+        printf(
+            "Staleness from update to write confirmed: mean %lu us, max %lu us\r\n",
+            (unsigned long) stats.mean_staleness_us(),
+            (unsigned long) stats.max_staleness_us
+        );
+
+        end_session();
+    }
+
+    uint32_t now_us() const {
+        return duration_cast<microseconds>(_coalescing_clock.elapsed_time()).count();
+    }
+#endif // MBED_CONF_APP_COALESCING_WRITES
+
+#if MBED_CONF_APP_BULK_UPLOAD
+private:
+    /**
+     * Upload MBED_CONF_APP_BULK_UPLOAD_SIZE bytes to the upload characteristic.
+     *
+     * With write requests a chunk is written once the previous one is
+     * acknowledged. With write commands the stack accepts up to
+     * MBED_CONF_APP_BULK_UPLOAD_CREDITS chunks ahead: each one sent, reported
+     * to on_write, returns a credit and the next chunk is queued right away so
+     * the controller always has data to send.
+     */
+    void start_upload(upload_method_t method) {
+        const DiscoveredCharacteristic::Properties_t &properties = upload_characteristic.getProperties();
+
+        if (method == UPLOAD_WRITE_COMMAND && !properties.writeWoResp()) {
+            printf("The characteristic doesn't accept writes without response, skipped\r\n");
+            method = UPLOAD_SIGNED_WRITE_COMMAND;
+        }
+
+        if (method == UPLOAD_SIGNED_WRITE_COMMAND && !properties.authSignedWrite()) {
+            printf("The characteristic doesn't accept signed writes, skipped\r\n");
+            method = UPLOAD_DONE;
+        }
+
+        if (method == UPLOAD_SIGNED_WRITE_COMMAND && !_upload_bonded) {
+            bond_for_signing();
+            return;
+        }
+
+        if (method == UPLOAD_DONE) {
             /* this concludes the example, we stop the app running the ble process in the background */
             _ble_app.stop();
+            return;
+        }
+
+        _upload_method = method;
+        _upload_offset = 0;
+        _upload_in_flight = 0;
+        _upload_issued = 0;
+        _upload_refused = 0;
+        _upload_stalled = false;
+        _upload_stall_time = 0us;
+        _upload_call_time = 0us;
+        _upload_stack_time = 0us;
+        _upload_latency_sum = 0us;
+        _upload_latency_max = 0us;
+        _upload_timer.reset();
+        _upload_timer.start();
+
+        printf(
+            "Uploading %u bytes with %s\r\n",
+            MBED_CONF_APP_BULK_UPLOAD_SIZE,
+            upload_method_name(method)
+        );
+
+        upload();
+    }
+
+    static const char *upload_method_name(upload_method_t method) {
+        static const char *const names[] = { "write requests", "write commands", "signed write commands" };
+        return names[method];
+    }
+
+    /**
+     * Write chunks until the upload is done or no credit is left.
+     */
+    void upload() {
+        const unsigned int credits = _upload_method == UPLOAD_WRITE_REQUEST ? 1 : MBED_CONF_APP_BULK_UPLOAD_CREDITS;
+
+        while (_upload_offset < MBED_CONF_APP_BULK_UPLOAD_SIZE && _upload_in_flight < credits) {
+            uint16_t length = _att_mtu - 3;
+            if (_upload_method == UPLOAD_SIGNED_WRITE_COMMAND) {
+                length -= SIGNATURE_SIZE;
+            }
+            if (length > UPLOAD_MAX_CHUNK) {
+                length = UPLOAD_MAX_CHUNK;
+            }
+            if (length > MBED_CONF_APP_BULK_UPLOAD_SIZE - _upload_offset) {
+                length = MBED_CONF_APP_BULK_UPLOAD_SIZE - _upload_offset;
+            }
+
+            /* the content of the blob is a byte counter */
+            for (uint16_t i = 0; i < length; ++i) {
+                _upload_chunk[i] = _upload_offset + i;
+            }
+
+            static const GattClient::WriteOp_t operations[] = {
+                GattClient::GATT_OP_WRITE_REQ,
+                GattClient::GATT_OP_WRITE_CMD,
+                GattClient::GATT_OP_SIGNED_WRITE_CMD
+            };
+
+            /* CPU time spent in the stack to issue the write */
+            microseconds issued = _upload_timer.elapsed_time();
+            ble_error_t error = _ble->gattClient().write(
+                operations[_upload_method],
+                _connection_handle,
+                upload_characteristic.getValueHandle(),
+                length,
+                _upload_chunk
+            );
+            _upload_call_time += _upload_timer.elapsed_time() - issued;
+
+            if (error == BLE_STACK_BUSY || error == BLE_ERROR_NO_MEM) {
+                /* TX buffers are full, wait for a credit; the stall lasts
+                 * until the stack accepts a write again */
+                _upload_refused++;
+                if (!_upload_stalled) {
+                    _upload_stall_timer.reset();
+                    _upload_stall_timer.start();
+                    _upload_stalled = true;
+                }
+                if (!_upload_in_flight) {
+                    _event_queue->call_in(BUSY_RETRY_DELAY, [this]{ upload(); });
+                }
+                break;
+            } else if (error && _upload_method == UPLOAD_SIGNED_WRITE_COMMAND && !_upload_offset) {
+                /* the first chunk is refused, the stack can't send signed writes on this link */
+                printf("Signed write commands refused with error %u, skipped\r\n", error);
+                _event_queue->call([this]{ start_upload(UPLOAD_DONE); });
+                return;
+            } else if (error) {
+                printf("Upload failed at offset %u with error %u\r\n", _upload_offset, error);
+                _ble_app.stop();
+                return;
+            }
+
+            if (_upload_stalled) {
+                _upload_stall_timer.stop();
+                _upload_stall_time += _upload_stall_timer.elapsed_time();
+                _upload_stalled = false;
+            }
+
+            /* writes complete in order, the issue times are kept in a ring */
+            _upload_issue_times[_upload_issued++ % MBED_CONF_APP_BULK_UPLOAD_CREDITS] = issued;
+            _upload_offset += length;
+            _upload_in_flight++;
         }
     }
 
+    void when_upload_written(const GattWriteCallbackParams *response) {
+        if (response->status) {
+            printf("Upload failed at offset %u with error %u\r\n", _upload_offset, response->status);
+            _ble_app.stop();
+            return;
+        }
+
+        if (_upload_in_flight) {
+            size_t completed = _upload_issued - _upload_in_flight;
+            microseconds latency =
+                _upload_timer.elapsed_time() - _upload_issue_times[completed % MBED_CONF_APP_BULK_UPLOAD_CREDITS];
+            _upload_latency_sum += latency;
+            if (latency > _upload_latency_max) {
+                _upload_latency_max = latency;
+            }
+            _upload_in_flight--;
+        }
+
+        if (_upload_offset < MBED_CONF_APP_BULK_UPLOAD_SIZE) {
+            upload();
+            return;
+        }
+
+        if (_upload_in_flight) {
+            return;
+        }
+
+        _upload_timer.stop();
+        report_upload();
+
+        /* compare the methods one after the other */
+        start_upload(static_cast<upload_method_t>(_upload_method + 1));
+    }
+
+    void report_upload() {
+        int duration_ms = duration_cast<milliseconds>(_upload_timer.elapsed_time()).count();
+        int stall_ms = duration_cast<milliseconds>(_upload_stall_time).count();
+
+        printf(
+            "Uploaded %u bytes with %s in %d ms: %lu bytes/s, stalled %d ms, %u writes refused, ATT_MTU %u\r\n",
+            MBED_CONF_APP_BULK_UPLOAD_SIZE,
+            upload_method_name(_upload_method),
+            duration_ms,
+            duration_ms ? (unsigned long) MBED_CONF_APP_BULK_UPLOAD_SIZE * 1000 / duration_ms : 0UL,
+            stall_ms,
+            _upload_refused,
+            _att_mtu
+        );
+
+        /* latency from the write issued to its response, or to the command sent */
+        printf(
+            "%u writes: latency mean %lu us, max %lu us, CPU time per write %lu us to issue, %lu us in the stack\r\n",
+            _upload_issued,
+            _upload_issued ? (unsigned long) (_upload_latency_sum.count() / _upload_issued) : 0UL,
+            (unsigned long) _upload_latency_max.count(),
+            _upload_issued ? (unsigned long) (_upload_call_time.count() / _upload_issued) : 0UL,
+            _upload_issued ? (unsigned long) (_upload_stack_time.count() / _upload_issued) : 0UL
+        );
+    }
+
+    /**
+     * Pair with the server, the keys distributed include the CSRK signing
+     * the writes and the bond keeps it.
+     *
+     * The stack doesn't sign writes on an encrypted link, once bonded the
+     * link is dropped and the server reconnected without encryption.
+     */
+    void bond_for_signing() {
+        printf("Bonding to exchange the signing keys\r\n");
+
+        ble_error_t error = _ble->securityManager().requestPairing(_connection_handle);
+        if (error) {
+            printf("Pairing failed to start with error %u, signed writes skipped\r\n", error);
+            start_upload(UPLOAD_DONE);
+        }
+    }
+
+    void pairingResult(
+        ble::connection_handle_t connectionHandle,
+        SecurityManager::SecurityCompletionStatus_t result
+    ) override {
+        if (result != SecurityManager::SEC_STATUS_SUCCESS) {
+            printf("Pairing failed with status %u, signed writes skipped\r\n", result);
+            _event_queue->call([this]{ start_upload(UPLOAD_DONE); });
+            return;
+        }
+
+        printf("Bonded, reconnecting without encryption\r\n");
+        _upload_bonded = true;
+        _upload_reconnecting = true;
+        _ble->gap().disconnect(connectionHandle, ble::local_disconnection_reason_t::USER_TERMINATION);
+    }
+
+    void onDisconnectionComplete(const ble::DisconnectionCompleteEvent &event) {
+        if (!_upload_reconnecting) {
+            return;
+        }
+
+        /* BLEApp scans again once disconnected, the server is reconnected directly instead */
+        _event_queue->call([this]{ connect_to_peer(); });
+    }
+
+    /**
+     * Process the events of the stack as BLEApp does, timing it. Signing a
+     * write happens here, after write() returned.
+     */
+    void schedule_ble_events(BLE::OnEventsToProcessCallbackContext *context) {
+        _event_queue->call([this]{
+            /* the upload timer only runs during an upload */
+            microseconds start = _upload_timer.elapsed_time();
+            _ble->processEvents();
+            _upload_stack_time += _upload_timer.elapsed_time() - start;
+        });
+    }
+#endif // MBED_CONF_APP_BULK_UPLOAD
+
 private:
     GattClientDemo() {};
     ~GattClientDemo() {};
@@ -130,8 +732,64 @@ private:
     BLE *_ble = nullptr;
     events::EventQueue *_event_queue = nullptr;
 
+    uint16_t _att_mtu = 23;
+
     DiscoveredCharacteristic writable_characteristic;
     bool writable_characteristic_found = false;
+
+#if MBED_CONF_APP_KEEP_ALIVE || MBED_CONF_APP_BULK_UPLOAD
+    ble::connection_handle_t _connection_handle = 0;
+    ble::peer_address_type_t _peer_address_type = ble::peer_address_type_t::PUBLIC;
+    ble::address_t _peer_address;
+    ble::conn_interval_t _connection_interval = ble::conn_interval_t::min();
+    ble::slave_latency_t _connection_latency = ble::slave_latency_t(0);
+    ble::supervision_timeout_t _supervision_timeout = ble::supervision_timeout_t::max();
+#endif // MBED_CONF_APP_KEEP_ALIVE || MBED_CONF_APP_BULK_UPLOAD
+
+#if MBED_CONF_APP_KEEP_ALIVE
+    /* the writable characteristic of the last peer is known */
+    bool _peer_known = false;
+
+    /* time from the wake up to the value written */
+    mbed::Timer _cycle_timer;
+    unsigned int _cycle = 0;
+    bool _cycle_reconnected = false;
+#endif // MBED_CONF_APP_KEEP_ALIVE
+
+#if MBED_CONF_APP_COALESCING_WRITES
+    CoalescingWriter _coalescing_writer;
+    mbed::Timer _coalescing_clock;
+    int _coalescing_event = 0;
+    int _coalescing_retry_event = 0;
+    uint8_t _coalescing_value = 0;
+    unsigned int _coalescing_updates = 0;
+#endif // MBED_CONF_APP_COALESCING_WRITES
+
+#if MBED_CONF_APP_BULK_UPLOAD
+    DiscoveredCharacteristic upload_characteristic;
+    bool upload_characteristic_found = false;
+
+    upload_method_t _upload_method = UPLOAD_WRITE_REQUEST;
+    unsigned int _upload_offset = 0;
+    unsigned int _upload_in_flight = 0;
+    unsigned int _upload_refused = 0;
+    unsigned int _upload_issued = 0;
+    uint8_t _upload_chunk[UPLOAD_MAX_CHUNK];
+    microseconds _upload_issue_times[MBED_CONF_APP_BULK_UPLOAD_CREDITS];
+    microseconds _upload_call_time = 0us;
+    microseconds _upload_stack_time = 0us;
+    microseconds _upload_latency_sum = 0us;
+    microseconds _upload_latency_max = 0us;
+
+    mbed::Timer _upload_timer;
+    mbed::Timer _upload_stall_timer;
+    microseconds _upload_stall_time = 0us;
+    bool _upload_stalled = false;
+
+    /* the CSRK is exchanged, the link is dropped to sign without encryption */
+    bool _upload_bonded = false;
+    bool _upload_reconnecting = false;
+#endif // MBED_CONF_APP_BULK_UPLOAD
 };
 
 /* redirect to demo instance functions */
@@ -19,6 +19,9 @@
 #include "ble/BLE.h"
 #include "gatt_server_process.h"
 #include "mbed-trace/mbed_trace.h"
+#include "throughput_service.h"
+#include "notification_fanout.h"
+#include "drivers/Timer.h"
 
 using mbed::callback;
 using namespace std::literals::chrono_literals;
@@ -33,8 +36,14 @@ using namespace std::literals::chrono_literals;
  * A client can subscribe to updates of the clock characteristics and get
  * notified when one of the value is changed. Clients can also change value of
  * the second, minute and hour characteristric.
+ *
+ * The current time is kept in shadow variables, the GattServer is only
+ * written when a value changes and never read back.
+ *
+ * With notification-fanout, updates go through a queue per subscribed
+ * connection instead of being notified to every client at once.
  */
-class ClockService : public ble::GattServer::EventHandler {
+class ClockService : public ble::GattServer::EventHandler, public ble::Gap::EventHandler {
 public:
     ClockService() :
         _hour_char("485f4145-52b9-4644-af1f-7a6b9322490f", 0),
@@ -74,6 +83,19 @@ public:
         /* register handlers */
         _server->setEventHandler(this);
 
+#if MBED_CONF_APP_NOTIFICATION_FANOUT
+        // the clients are dropped from the fanout when their link goes down
+        _gap_event_handlers.addEventHandler(_process_gap_event_handler);
+        _gap_event_handlers.addEventHandler(this);
+        ble.gap().setEventHandler(&_gap_event_handlers);
+
+        _fanout.reset(_server);
+        _fanout.add_handle(_hour_char.getValueHandle());
+        _fanout.add_handle(_minute_char.getValueHandle());
+        _fanout.add_handle(_second_char.getValueHandle());
+        _timer.start();
+#endif // MBED_CONF_APP_NOTIFICATION_FANOUT
+
         printf("clock service registered\r\n");
         printf("service handle: %u\r\n", _clock_service.getHandle());
         printf("hour characteristic value handle %u\r\n", _hour_char.getValueHandle());
@@ -83,6 +105,40 @@ public:
         _event_queue->call_every(1000ms, callback(this, &ClockService::increment_second));
     }
 
+#if MBED_CONF_APP_NOTIFICATION_FANOUT
+    /**
+     * Set the GAP event handler of the process, GAP events are dispatched to
+     * it and to the service.
+     *
+     * @note Must be called before start().
+     */
+    void set_process_gap_event_handler(ble::Gap::EventHandler *handler)
+    {
+        _process_gap_event_handler = handler;
+    }
+
+    /**
+     * Keep advertising so that more clients can subscribe.
+     */
+    void on_connect(BLE &ble, events::EventQueue &event_queue, const ble::ConnectionCompleteEvent &event)
+    {
+        ble_error_t err = ble.gap().startAdvertising(ble::LEGACY_ADVERTISING_HANDLE);
+        if (err) {
+            printf("Error %u restarting advertising, no more clients accepted.\r\n", err);
+        }
+    }
+
+    /* Gap::EventHandler */
+private:
+    /**
+     * Drop the updates waiting for a client whose link went down.
+     */
+    void onDisconnectionComplete(const ble::DisconnectionCompleteEvent &event) override
+    {
+        _fanout.remove_client(event.getConnectionHandle());
+    }
+#endif // MBED_CONF_APP_NOTIFICATION_FANOUT
+
     /* GattServer::EventHandler */
 private:
     /**
@@ -91,6 +147,10 @@ private:
     void onDataSent(const GattDataSentCallbackParams &params) override
     {
         printf("sent updates\r\n");
+        _updates_sent++;
+#if MBED_CONF_APP_NOTIFICATION_FANOUT
+        _fanout.on_data_sent(params.connHandle, now_us());
+#endif // MBED_CONF_APP_NOTIFICATION_FANOUT
     }
 
     /**
@@ -120,6 +180,17 @@ private:
         }
 
         printf("\r\n");
+
+        /* the write was authorized, keep the shadow in sync with the new value */
+        if (params.len == 1) {
+            if (params.handle == _hour_char.getValueHandle()) {
+                _hour = params.data[0];
+            } else if (params.handle == _minute_char.getValueHandle()) {
+                _minute = params.data[0];
+            } else if (params.handle == _second_char.getValueHandle()) {
+                _second = params.data[0];
+            }
+        }
     }
 
     /**
@@ -149,6 +220,11 @@ private:
     void onUpdatesEnabled(const GattUpdatesEnabledCallbackParams &params) override
     {
         printf("update enabled on handle %d\r\n", params.attHandle);
+#if MBED_CONF_APP_NOTIFICATION_FANOUT
+        if (!_fanout.subscribe(params.connHandle, params.attHandle)) {
+            printf("no room left for the updates of connection %u\r\n", params.connHandle);
+        }
+#endif // MBED_CONF_APP_NOTIFICATION_FANOUT
     }
 
     /**
@@ -160,6 +236,9 @@ private:
     void onUpdatesDisabled(const GattUpdatesDisabledCallbackParams &params) override
     {
         printf("update disabled on handle %d\r\n", params.attHandle);
+#if MBED_CONF_APP_NOTIFICATION_FANOUT
+        _fanout.unsubscribe(params.connHandle, params.attHandle);
+#endif // MBED_CONF_APP_NOTIFICATION_FANOUT
     }
 
     /**
@@ -171,6 +250,10 @@ private:
     void onConfirmationReceived(const GattConfirmationReceivedCallbackParams &params) override
     {
         printf("confirmation received on handle %d\r\n", params.attHandle);
+#if MBED_CONF_APP_NOTIFICATION_FANOUT
+        /* the confirmation gives back the credit of an indication */
+        _fanout.on_data_sent(params.connHandle, now_us());
+#endif // MBED_CONF_APP_NOTIFICATION_FANOUT
     }
 
 private:
@@ -208,74 +291,118 @@ private:
 
     /**
      * Increment the second counter.
+     *
+     * The shadow values are incremented first, then the characteristics
+     * changed are written back to back so that the notifications of a
+     * rollover leave in the same connection event.
      */
     void increment_second(void)
     {
-        uint8_t second = 0;
-        ble_error_t err = _second_char.get(*_server, second);
-        if (err) {
-            printf("read of the second value returned error %u\r\n", err);
-            return;
+        report_tick();
+
+        _second = (_second + 1) % 60;
+
+        bool minute_changed = (_second == 0);
+        if (minute_changed) {
+            _minute = (_minute + 1) % 60;
         }
 
-        second = (second + 1) % 60;
+        bool hour_changed = minute_changed && (_minute == 0);
+        if (hour_changed) {
+            _hour = (_hour + 1) % 24;
+        }
 
-        err = _second_char.set(*_server, second);
-        if (err) {
-            printf("write of the second value returned error %u\r\n", err);
+        if (hour_changed && !update(_hour_char, _hour, "hour")) {
             return;
         }
 
-        if (second == 0) {
-            increment_minute();
+        if (minute_changed && !update(_minute_char, _minute, "minute")) {
+            return;
         }
+
+        update(_second_char, _second, "second");
     }
 
     /**
-     * Increment the minute counter.
+     * Write the new value of a characteristic, it is notified to the
+     * subscribed clients.
+     *
+     * @return false if the write failed.
      */
-    void increment_minute(void)
+    template<typename Characteristic>
+    bool update(const Characteristic &characteristic, uint8_t value, const char *name)
     {
-        uint8_t minute = 0;
-        ble_error_t err = _minute_char.get(*_server, minute);
+#if MBED_CONF_APP_NOTIFICATION_FANOUT
+        ble_error_t err = _fanout.update(characteristic.getValueHandle(), &value, sizeof(value), now_us());
+#else
+        _server_calls++;
+        ble_error_t err = characteristic.set(*_server, value);
+#endif // MBED_CONF_APP_NOTIFICATION_FANOUT
         if (err) {
-            printf("read of the minute value returned error %u\r\n", err);
-            return;
+            printf("write of the %s value returned error %u\r\n", name, err);
+            return false;
         }
+        return true;
+    }
 
-        minute = (minute + 1) % 60;
-
-        err = _minute_char.set(*_server, minute);
-        if (err) {
-            printf("write of the minute value returned error %u\r\n", err);
-            return;
+    /**
+     * Print the GattServer calls made by the last tick and the updates sent
+     * since then.
+     */
+    void report_tick(void)
+    {
+#if MBED_CONF_APP_NOTIFICATION_FANOUT
+        /* the fanout also writes when a credit comes back */
+        uint32_t server_calls = _fanout.server_calls();
+        _server_calls = server_calls - _server_calls_reported;
+        _server_calls_reported = server_calls;
+
+        if (_second % 10 == 0) {
+            report_clients();
         }
+#endif // MBED_CONF_APP_NOTIFICATION_FANOUT
 
-        if (minute == 0) {
-            increment_hour();
+        if (_server_calls) {
+            printf("tick: %u GattServer calls, %u updates sent\r\n", _server_calls, _updates_sent);
         }
+        _server_calls = 0;
+        _updates_sent = 0;
     }
 
+#if MBED_CONF_APP_NOTIFICATION_FANOUT
     /**
-     * Increment the hour counter.
+     * Print the queue depth, drops and update latency of each client.
      */
-    void increment_hour(void)
+    void report_clients(void)
     {
-        uint8_t hour = 0;
-        ble_error_t err = _hour_char.get(*_server, hour);
-        if (err) {
-            printf("read of the hour value returned error %u\r\n", err);
-            return;
+        for (size_t i = 0; i < _fanout.capacity(); ++i) {
+            const ClockFanout::client_t &client = _fanout.client(i);
+            if (!client.used) {
+                continue;
+            }
+
+            const ClockFanout::stats_t &stats = client.stats;
+            printf(
+                "connection %u: %u waiting (max %u), %u in flight, %lu sent, %lu dropped, %lu failed, "
+                "latency mean %lu us, max %lu us\r\n",
+                client.connection_handle,
+                client.depth(),
+                stats.max_depth,
+                client.in_flight,
+                (unsigned long) stats.sent,
+                (unsigned long) stats.dropped,
+                (unsigned long) stats.failed,
+                (unsigned long) stats.mean_latency_us(),
+                (unsigned long) stats.max_latency_us
+            );
         }
+    }
 
-        hour = (hour + 1) % 24;
-
-        err = _hour_char.set(*_server, hour);
-        if (err) {
-            printf("write of the hour value returned error %u\r\n", err);
-            return;
-        }
+    uint32_t now_us() const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(_timer.elapsed_time()).count();
     }
+#endif // MBED_CONF_APP_NOTIFICATION_FANOUT
 
 private:
     /**
@@ -352,6 +479,29 @@ private:
     ReadWriteNotifyIndicateCharacteristic<uint8_t> _hour_char;
     ReadWriteNotifyIndicateCharacteristic<uint8_t> _minute_char;
     ReadWriteNotifyIndicateCharacteristic<uint8_t> _second_char;
+
+    /* authoritative values of the characteristics */
+    uint8_t _hour = 0;
+    uint8_t _minute = 0;
+    uint8_t _second = 0;
+
+    unsigned _server_calls = 0;
+    unsigned _updates_sent = 0;
+
+#if MBED_CONF_APP_NOTIFICATION_FANOUT
+    typedef NotificationFanout<
+        MBED_CONF_APP_NOTIFICATION_FANOUT_CLIENTS,
+        /* hour, minute and second */ 3,
+        sizeof(uint8_t),
+        MBED_CONF_APP_NOTIFICATION_FANOUT_CREDITS
+    > ClockFanout;
+
+    ClockFanout _fanout;
+    ChainableGapEventHandler _gap_event_handlers;
+    ble::Gap::EventHandler *_process_gap_event_handler = nullptr;
+    mbed::Timer _timer;
+    uint32_t _server_calls_reported = 0;
+#endif // MBED_CONF_APP_NOTIFICATION_FANOUT
 };
 
 int main()
@@ -360,13 +510,24 @@ int main()
 
     BLE &ble = BLE::Instance();
     events::EventQueue event_queue;
+#if MBED_CONF_APP_THROUGHPUT_SERVICE
+    ThroughputService demo_service;
+    typedef ThroughputService DemoService;
+#else
     ClockService demo_service;
+    typedef ClockService DemoService;
+#endif // MBED_CONF_APP_THROUGHPUT_SERVICE
 
     /* this process will handle basic ble setup and advertising for us */
     GattServerProcess ble_process(event_queue, ble);
 
     /* once it's done it will let us continue with our demo */
-    ble_process.on_init(callback(&demo_service, &ClockService::start));
+    ble_process.on_init(callback(&demo_service, &DemoService::start));
+
+#if MBED_CONF_APP_NOTIFICATION_FANOUT && !MBED_CONF_APP_THROUGHPUT_SERVICE
+    demo_service.set_process_gap_event_handler(&ble_process);
+    ble_process.on_connect(callback(&demo_service, &ClockService::on_connect));
+#endif // MBED_CONF_APP_NOTIFICATION_FANOUT && !MBED_CONF_APP_THROUGHPUT_SERVICE
 
     ble_process.start();
 
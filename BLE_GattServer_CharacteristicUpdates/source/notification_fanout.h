@@ -0,0 +1,412 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOTIFICATION_FANOUT_H_
+#define NOTIFICATION_FANOUT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ble/BLE.h"
+#include "ble/GattServer.h"
+
+/**
+ * Per connection queues of the updates sent to subscribed clients.
+ *
+ * GattServer::write() notifies every subscribed client at once, a client
+ * whose buffers are full loses the update without the application knowing.
+ * Here a new value is written locally then queued for each client subscribed
+ * to the attribute, and sent to each connection separately.
+ *
+ * A queue holds the latest value of each attribute: a value still waiting is
+ * replaced by the new one and counted as dropped, so a queue never grows past
+ * the number of attributes. A client has at most Credits updates in flight,
+ * each one reported sent gives its credit back. A slow client keeps its own
+ * values waiting and doesn't delay the other clients.
+ *
+ * The latency of an update is the time from the submission of its value to
+ * the stack reporting it sent. Time is passed in by the caller, in
+ * microseconds. Data sent and confirmation received events must be forwarded
+ * to on_data_sent().
+ *
+ * @tparam Clients Maximum number of clients subscribed.
+ * @tparam Handles Maximum number of attributes updated.
+ * @tparam MaxValueLength Maximum length of a value.
+ * @tparam Credits Maximum number of updates in flight per client.
+ */
+template<size_t Clients, size_t Handles, size_t MaxValueLength, size_t Credits>
+class NotificationFanout {
+public:
+    struct stats_t {
+        /* updates handed to the stack */
+        uint32_t sent;
+        /* values replaced by a newer one before being sent */
+        uint32_t dropped;
+        /* updates refused by the stack */
+        uint32_t failed;
+        /* largest number of values waiting */
+        uint16_t max_depth;
+        uint64_t latency_sum_us;
+        uint32_t max_latency_us;
+        /* updates reported sent */
+        uint32_t completed;
+
+        uint32_t mean_latency_us() const
+        {
+            return completed ? (uint32_t) (latency_sum_us / completed) : 0;
+        }
+    };
+
+    struct client_t {
+        bool used;
+        ble::connection_handle_t connection_handle;
+        /* updates waiting for their credit back */
+        uint8_t in_flight;
+        stats_t stats;
+
+        /** Number of values waiting to be sent */
+        uint16_t depth() const
+        {
+            uint16_t count = 0;
+            for (size_t i = 0; i < Handles; ++i) {
+                if (slots[i].pending) {
+                    count++;
+                }
+            }
+            return count;
+        }
+
+    private:
+        friend class NotificationFanout;
+
+        struct slot_t {
+            bool subscribed;
+            bool pending;
+            uint16_t length;
+            uint32_t submitted_us;
+            uint8_t value[MaxValueLength];
+        };
+
+        slot_t slots[Handles];
+        /* slot visited first by the next update sent */
+        uint8_t next_slot;
+        /* submission time of the updates in flight, oldest first */
+        uint32_t in_flight_submitted_us[Credits];
+        uint8_t oldest;
+    };
+
+    /**
+     * Use the fanout on a GattServer, the clients and attributes are dropped.
+     */
+    void reset(GattServer *server)
+    {
+        _server = server;
+        _handle_count = 0;
+        _next_client = 0;
+        _server_calls = 0;
+        for (size_t i = 0; i < Clients; ++i) {
+            _clients[i].used = false;
+        }
+    }
+
+    /**
+     * Add an attribute updated through the fanout.
+     *
+     * @return false if no room is left.
+     */
+    bool add_handle(GattAttribute::Handle_t handle)
+    {
+        if (_handle_count == Handles) {
+            return false;
+        }
+        _handles[_handle_count++] = handle;
+        return true;
+    }
+
+    /**
+     * Register the subscription of a connection to an attribute.
+     *
+     * @return false if the attribute isn't handled or no client slot is left.
+     */
+    bool subscribe(ble::connection_handle_t connection_handle, GattAttribute::Handle_t handle)
+    {
+        int index = handle_index(handle);
+        if (index < 0) {
+            return false;
+        }
+
+        client_t *client = find(connection_handle);
+        if (!client) {
+            client = allocate(connection_handle);
+            if (!client) {
+                return false;
+            }
+        }
+
+        client->slots[index].subscribed = true;
+        return true;
+    }
+
+    /**
+     * Remove the subscription of a connection to an attribute, the client is
+     * dropped once it has no subscription left.
+     */
+    void unsubscribe(ble::connection_handle_t connection_handle, GattAttribute::Handle_t handle)
+    {
+        int index = handle_index(handle);
+        client_t *client = find(connection_handle);
+        if (index < 0 || !client) {
+            return;
+        }
+
+        client->slots[index].subscribed = false;
+        client->slots[index].pending = false;
+
+        for (size_t i = 0; i < _handle_count; ++i) {
+            if (client->slots[i].subscribed) {
+                return;
+            }
+        }
+        client->used = false;
+    }
+
+    /** Drop a connection and the values waiting for it */
+    void remove_client(ble::connection_handle_t connection_handle)
+    {
+        client_t *client = find(connection_handle);
+        if (client) {
+            client->used = false;
+        }
+    }
+
+    /**
+     * Write the new value of an attribute and queue it for the subscribed
+     * clients.
+     *
+     * @return BLE_ERROR_INVALID_PARAM if the attribute isn't handled or the
+     * value too long, the error of the local write otherwise.
+     */
+    ble_error_t update(GattAttribute::Handle_t handle, const uint8_t *value, uint16_t length, uint32_t now_us)
+    {
+        int index = handle_index(handle);
+        if (index < 0 || length > MaxValueLength) {
+            return BLE_ERROR_INVALID_PARAM;
+        }
+
+        _server_calls++;
+        ble_error_t err = _server->write(handle, value, length, /* local_only */ true);
+        if (err) {
+            return err;
+        }
+
+        for (size_t i = 0; i < Clients; ++i) {
+            client_t &client = _clients[i];
+            typename client_t::slot_t &slot = client.slots[index];
+            if (!client.used || !slot.subscribed) {
+                continue;
+            }
+
+            if (slot.pending) {
+                client.stats.dropped++;
+            }
+
+            memcpy(slot.value, value, length);
+            slot.length = length;
+            slot.submitted_us = now_us;
+            slot.pending = true;
+
+            uint16_t depth = client.depth();
+            if (depth > client.stats.max_depth) {
+                client.stats.max_depth = depth;
+            }
+        }
+
+        flush();
+        return BLE_ERROR_NONE;
+    }
+
+    /**
+     * Give back the credit of the oldest update in flight on a connection
+     * and send the values waiting.
+     */
+    void on_data_sent(ble::connection_handle_t connection_handle, uint32_t now_us)
+    {
+        client_t *client = find(connection_handle);
+        if (client && client->in_flight) {
+            uint32_t latency_us = now_us - client->in_flight_submitted_us[client->oldest];
+            client->oldest = (client->oldest + 1) % Credits;
+            client->in_flight--;
+
+            client->stats.completed++;
+            client->stats.latency_sum_us += latency_us;
+            if (latency_us > client->stats.max_latency_us) {
+                client->stats.max_latency_us = latency_us;
+            }
+        }
+
+        flush();
+    }
+
+    /** Client slot at index, check client_t::used before reading it */
+    const client_t &client(size_t index) const
+    {
+        return _clients[index];
+    }
+
+    size_t capacity() const
+    {
+        return Clients;
+    }
+
+    /** Number of GattServer writes made since the reset */
+    uint32_t server_calls() const
+    {
+        return _server_calls;
+    }
+
+private:
+    int handle_index(GattAttribute::Handle_t handle) const
+    {
+        for (size_t i = 0; i < _handle_count; ++i) {
+            if (_handles[i] == handle) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    client_t *find(ble::connection_handle_t connection_handle)
+    {
+        for (size_t i = 0; i < Clients; ++i) {
+            if (_clients[i].used && _clients[i].connection_handle == connection_handle) {
+                return &_clients[i];
+            }
+        }
+        return nullptr;
+    }
+
+    client_t *allocate(ble::connection_handle_t connection_handle)
+    {
+        for (size_t i = 0; i < Clients; ++i) {
+            client_t &client = _clients[i];
+            if (client.used) {
+                continue;
+            }
+
+            client.used = true;
+            client.connection_handle = connection_handle;
+            client.in_flight = 0;
+            client.stats = stats_t();
+            client.next_slot = 0;
+            client.oldest = 0;
+            for (size_t j = 0; j < Handles; ++j) {
+                client.slots[j].subscribed = false;
+                client.slots[j].pending = false;
+            }
+            return &client;
+        }
+        return nullptr;
+    }
+
+    /**
+     * Send the values waiting to the clients with credits left. Clients are
+     * visited in turn, starting after the first one visited last time, so
+     * the stack buffers are shared between them.
+     */
+    void flush()
+    {
+        if (!_server) {
+            return;
+        }
+
+        size_t first = _next_client;
+        _next_client = (_next_client + 1) % Clients;
+
+        for (size_t n = 0; n < Clients; ++n) {
+            client_t &client = _clients[(first + n) % Clients];
+            if (client.used && !flush(client)) {
+                // the stack is out of buffers, wait for an update to be sent
+                return;
+            }
+        }
+    }
+
+    /**
+     * Send the values waiting for a client while it has credits left.
+     *
+     * @return false if the stack refused an update for lack of buffers.
+     */
+    bool flush(client_t &client)
+    {
+        while (client.in_flight < Credits) {
+            size_t index = next_pending(client);
+            if (index == _handle_count) {
+                return true;
+            }
+
+            typename client_t::slot_t &slot = client.slots[index];
+            _server_calls++;
+            ble_error_t err = _server->write(
+                client.connection_handle,
+                _handles[index],
+                slot.value,
+                slot.length
+            );
+
+            if (err == BLE_STACK_BUSY || err == BLE_ERROR_NO_MEM) {
+                return false;
+            }
+
+            slot.pending = false;
+            client.next_slot = (index + 1) % _handle_count;
+
+            if (err) {
+                client.stats.failed++;
+                continue;
+            }
+
+            client.in_flight_submitted_us[(client.oldest + client.in_flight) % Credits] = slot.submitted_us;
+            client.in_flight++;
+            client.stats.sent++;
+        }
+        return true;
+    }
+
+    /* index of the next slot waiting, _handle_count if none */
+    size_t next_pending(const client_t &client) const
+    {
+        for (size_t n = 0; n < _handle_count; ++n) {
+            size_t index = (client.next_slot + n) % _handle_count;
+            if (client.slots[index].pending) {
+                return index;
+            }
+        }
+        return _handle_count;
+    }
+
+    GattServer *_server = nullptr;
+    uint32_t _server_calls = 0;
+
+    size_t _handle_count = 0;
+    GattAttribute::Handle_t _handles[Handles];
+
+    /* client visited first by the next flush */
+    size_t _next_client = 0;
+    client_t _clients[Clients];
+};
+
+#endif // NOTIFICATION_FANOUT_H_
@@ -0,0 +1,255 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THROUGHPUT_SERVICE_H_
+#define THROUGHPUT_SERVICE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "events/EventQueue.h"
+#include "drivers/Timer.h"
+#include "ble/BLE.h"
+
+/**
+ * Test service streaming notifications as fast as the link allows.
+ *
+ * The service hosts two characteristics:
+ * - data: notifies payloads starting with a sequence number and the time
+ *   they were sent in microseconds, both little endian 32 bit words. The rest
+ *   of the payload is filler.
+ * - control: the client writes the payload length as a little endian 16 bit
+ *   word, 0 stops the stream.
+ *
+ * The stream runs while a client is subscribed to the data characteristic
+ * and the payload length isn't 0. Notifications are queued until the stack
+ * refuses them or MBED_CONF_APP_THROUGHPUT_NOTIFICATIONS_IN_FLIGHT are
+ * waiting to be sent; each one sent makes room for the next.
+ *
+ * The throughput benchmark of the BLE_GattClient_CharacteristicUpdates
+ * example drives this service.
+ */
+class ThroughputService : public ble::GattServer::EventHandler {
+public:
+    static const uint16_t MAX_PAYLOAD = MBED_CONF_APP_THROUGHPUT_MAX_PAYLOAD;
+
+    ThroughputService() :
+        _data_char(
+            /* UUID */ "a4c3b201-6f3c-4b7e-9d2b-0d1f6c7e8a10",
+            /* Initial value */ _data,
+            /* Value size */ 0,
+            /* Value capacity */ sizeof(_data),
+            /* Properties */ GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY,
+            /* Descriptors */ nullptr,
+            /* Num descriptors */ 0,
+            /* variable len */ true
+        ),
+        _control_char(
+            /* UUID */ "a4c3b202-6f3c-4b7e-9d2b-0d1f6c7e8a10",
+            /* Initial value */ _control,
+            /* Value size */ sizeof(_control),
+            /* Value capacity */ sizeof(_control),
+            /* Properties */ GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
+                             GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE,
+            /* Descriptors */ nullptr,
+            /* Num descriptors */ 0,
+            /* variable len */ false
+        ),
+        _throughput_service(
+            /* uuid */ "a4c3b200-6f3c-4b7e-9d2b-0d1f6c7e8a10",
+            /* characteristics */ _throughput_characteristics,
+            /* numCharacteristics */ sizeof(_throughput_characteristics) /
+                                     sizeof(_throughput_characteristics[0])
+        )
+    {
+        _throughput_characteristics[0] = &_data_char;
+        _throughput_characteristics[1] = &_control_char;
+
+        _control_char.setWriteAuthorizationCallback(this, &ThroughputService::authorize_control_write);
+    }
+
+    void start(BLE &ble, events::EventQueue &event_queue)
+    {
+        _server = &ble.gattServer();
+
+        printf("Registering throughput test service\r\n");
+        ble_error_t err = _server->addService(_throughput_service);
+
+        if (err) {
+            printf("Error %u during throughput test service registration.\r\n", err);
+            return;
+        }
+
+        /* register handlers */
+        _server->setEventHandler(this);
+
+        printf("throughput test service registered\r\n");
+        printf("data characteristic value handle %u\r\n", _data_char.getValueHandle());
+        printf("control characteristic value handle %u\r\n", _control_char.getValueHandle());
+
+        _clock.start();
+    }
+
+    /* GattServer::EventHandler */
+private:
+    /**
+     * A notification left the queue, queue the next one.
+     */
+    void onDataSent(const GattDataSentCallbackParams &params) override
+    {
+        if (params.attHandle != _data_char.getValueHandle()) {
+            return;
+        }
+
+        if (_in_flight) {
+            --_in_flight;
+        }
+        stream();
+    }
+
+    /**
+     * Apply the payload length written by the client.
+     */
+    void onDataWritten(const GattWriteCallbackParams &params) override
+    {
+        if (params.handle != _control_char.getValueHandle()) {
+            return;
+        }
+
+        uint16_t payload = params.data[0] | (params.data[1] << 8);
+        if (payload && payload < HEADER_SIZE) {
+            payload = HEADER_SIZE;
+        }
+        if (payload > MAX_PAYLOAD) {
+            payload = MAX_PAYLOAD;
+        }
+        if (payload > _att_mtu - 3) {
+            payload = _att_mtu - 3;
+        }
+
+        printf("payload length set to %u, %lu notifications sent\r\n", payload, (unsigned long) _sequence);
+        _payload = payload;
+        stream();
+    }
+
+    void onUpdatesEnabled(const GattUpdatesEnabledCallbackParams &params) override
+    {
+        if (params.attHandle != _data_char.getValueHandle()) {
+            return;
+        }
+
+        printf("throughput client subscribed\r\n");
+        _connection_handle = params.connHandle;
+        _subscribed = true;
+        _in_flight = 0;
+        _sequence = 0;
+        stream();
+    }
+
+    void onUpdatesDisabled(const GattUpdatesDisabledCallbackParams &params) override
+    {
+        if (params.attHandle != _data_char.getValueHandle()) {
+            return;
+        }
+
+        printf("throughput client unsubscribed\r\n");
+        _subscribed = false;
+        _payload = 0;
+    }
+
+    void onAttMtuChange(ble::connection_handle_t connectionHandle, uint16_t attMtuSize) override
+    {
+        printf("ATT_MTU changed to %u\r\n", attMtuSize);
+        _att_mtu = attMtuSize;
+    }
+
+private:
+    /**
+     * Check the payload length written by the client.
+     */
+    void authorize_control_write(GattWriteAuthCallbackParams *e)
+    {
+        if (e->offset != 0) {
+            e->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_INVALID_OFFSET;
+            return;
+        }
+
+        if (e->len != sizeof(_control)) {
+            e->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_INVALID_ATT_VAL_LENGTH;
+            return;
+        }
+
+        e->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
+    }
+
+    /**
+     * Queue notifications until the stack refuses them or enough are waiting.
+     */
+    void stream()
+    {
+        while (_subscribed && _payload && _in_flight < MBED_CONF_APP_THROUGHPUT_NOTIFICATIONS_IN_FLIGHT) {
+            uint32_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(_clock.elapsed_time()).count();
+            write_u32(_data, _sequence);
+            write_u32(_data + 4, now_us);
+
+            ble_error_t err = _server->write(_connection_handle, _data_char.getValueHandle(), _data, _payload);
+            if (err == BLE_STACK_BUSY || err == BLE_ERROR_NO_MEM) {
+                // wait for a notification to be sent
+                return;
+            } else if (err) {
+                printf("notification failed with error %u, stream stopped\r\n", err);
+                _subscribed = false;
+                return;
+            }
+
+            ++_in_flight;
+            ++_sequence;
+        }
+    }
+
+    static void write_u32(uint8_t *data, uint32_t value)
+    {
+        data[0] = value;
+        data[1] = value >> 8;
+        data[2] = value >> 16;
+        data[3] = value >> 24;
+    }
+
+private:
+    /* sequence number and send time */
+    static const uint16_t HEADER_SIZE = 8;
+
+    GattServer *_server = nullptr;
+    mbed::Timer _clock;
+
+    ble::connection_handle_t _connection_handle = 0;
+    uint16_t _att_mtu = 23;
+    bool _subscribed = false;
+    uint16_t _payload = 0;
+    unsigned int _in_flight = 0;
+    uint32_t _sequence = 0;
+
+    uint8_t _data[MAX_PAYLOAD] = { 0 };
+    uint8_t _control[2] = { 0 };
+
+    GattCharacteristic _data_char;
+    GattCharacteristic _control_char;
+    GattCharacteristic* _throughput_characteristics[2];
+    GattService _throughput_service;
+};
+
+#endif // THROUGHPUT_SERVICE_H_
@@ -25,6 +25,10 @@ class GattServerDemo : ble::GattServer::EventHandler {
 
     const static uint16_t EXAMPLE_SERVICE_UUID         = 0xA000;
     const static uint16_t WRITABLE_CHARACTERISTIC_UUID = 0xA001;
+#if MBED_CONF_APP_UPLOAD_CHARACTERISTIC
+    const static uint16_t UPLOAD_CHARACTERISTIC_UUID   = 0xA002;
+    const static uint16_t UPLOAD_MAX_LENGTH            = MBED_CONF_APP_UPLOAD_MAX_LENGTH;
+#endif // MBED_CONF_APP_UPLOAD_CHARACTERISTIC
 
 public:
     GattServerDemo()
@@ -35,6 +39,29 @@ public:
         if (!_writable_characteristic) {
             printf("Allocation of ReadWriteGattCharacteristic failed\r\n");
         }
+
+#if MBED_CONF_APP_UPLOAD_CHARACTERISTIC
+        uint8_t upload_properties = GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE |
+                                    GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE;
+#if MBED_CONF_APP_UPLOAD_SIGNED_WRITES
+        upload_properties |= GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_AUTHENTICATED_SIGNED_WRITES;
+#endif // MBED_CONF_APP_UPLOAD_SIGNED_WRITES
+
+        _upload_characteristic = new GattCharacteristic(
+            /* UUID */ UPLOAD_CHARACTERISTIC_UUID,
+            /* Initial value */ _upload_value,
+            /* Value size */ 0,
+            /* Value capacity */ sizeof(_upload_value),
+            /* Properties */ upload_properties,
+            /* Descriptors */ nullptr,
+            /* Num descriptors */ 0,
+            /* variable len */ true
+        );
+
+        if (!_upload_characteristic) {
+            printf("Allocation of the upload characteristic failed\r\n");
+        }
+#endif // MBED_CONF_APP_UPLOAD_CHARACTERISTIC
     }
 
     ~GattServerDemo()
@@ -44,15 +71,38 @@ public:
     void start(BLE &ble, events::EventQueue &event_queue)
     {
         const UUID uuid = EXAMPLE_SERVICE_UUID;
+#if MBED_CONF_APP_UPLOAD_CHARACTERISTIC
+        GattCharacteristic* charTable[] = { _writable_characteristic, _upload_characteristic };
+#else
         GattCharacteristic* charTable[] = { _writable_characteristic };
-        GattService example_service(uuid, charTable, 1);
+#endif // MBED_CONF_APP_UPLOAD_CHARACTERISTIC
+        GattService example_service(uuid, charTable, sizeof(charTable) / sizeof(charTable[0]));
 
         ble.gattServer().addService(example_service);
 
         ble.gattServer().setEventHandler(this);
 
+#if MBED_CONF_APP_UPLOAD_SIGNED_WRITES
+        /* signed writes are checked with the CSRK the client distributes while bonding */
+        ble_error_t error = ble.securityManager().init(
+            /* enableBonding */ true,
+            /* requireMITM */ false,
+            /* iocaps */ SecurityManager::IO_CAPS_NONE,
+            /* passkey */ nullptr,
+            /* signing */ true
+        );
+        if (error) {
+            printf("Security manager initialisation failed with error %u, signed writes will be rejected\r\n", error);
+        }
+#endif // MBED_CONF_APP_UPLOAD_SIGNED_WRITES
+
         printf("Example service added with UUID 0xA000\r\n");
         printf("Connect and write to characteristic 0xA001\r\n");
+
+#if MBED_CONF_APP_UPLOAD_CHARACTERISTIC
+        printf("Upload data to characteristic 0xA002\r\n");
+        event_queue.call_every(1s, mbed::callback(this, &GattServerDemo::report_upload));
+#endif // MBED_CONF_APP_UPLOAD_CHARACTERISTIC
     }
 
 private:
@@ -66,11 +116,42 @@ private:
         if ((params.handle == _writable_characteristic->getValueHandle()) && (params.len == 1)) {
             printf("New characteristic value written: %x\r\n", *(params.data));
         }
+
+#if MBED_CONF_APP_UPLOAD_CHARACTERISTIC
+        if (params.handle == _upload_characteristic->getValueHandle()) {
+            /* uploads are too fast to print each write, they are reported every second */
+            _upload_bytes += params.len;
+            _upload_writes++;
+        }
+#endif // MBED_CONF_APP_UPLOAD_CHARACTERISTIC
     }
 
+#if MBED_CONF_APP_UPLOAD_CHARACTERISTIC
+    /**
+     * Print the data received on the upload characteristic since the last report.
+     */
+    void report_upload()
+    {
+        if (!_upload_writes) {
+            return;
+        }
+
+        printf("Upload: %lu bytes received in %lu writes\r\n", _upload_bytes, _upload_writes);
+        _upload_bytes = 0;
+        _upload_writes = 0;
+    }
+#endif // MBED_CONF_APP_UPLOAD_CHARACTERISTIC
+
 private:
     ReadWriteGattCharacteristic<uint8_t> *_writable_characteristic = nullptr;
     uint8_t _characteristic_value = 0;
+
+#if MBED_CONF_APP_UPLOAD_CHARACTERISTIC
+    GattCharacteristic *_upload_characteristic = nullptr;
+    uint8_t _upload_value[UPLOAD_MAX_LENGTH] = { 0 };
+    unsigned long _upload_bytes = 0;
+    unsigned long _upload_writes = 0;
+#endif // MBED_CONF_APP_UPLOAD_CHARACTERISTIC
 };
 
 int main()
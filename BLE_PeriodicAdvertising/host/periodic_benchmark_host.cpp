@@ -0,0 +1,256 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "periodic_benchmark.h"
+
+/** Run the bulk data benchmark pair against a simulated controller on a host.
+ *
+ * The transmitter and receiver of periodic_benchmark.h are driven the way the
+ * example drives them on a board. The simulated controller sends the payload
+ * at every periodic event as a chain of PDUs, loses some of them and reports
+ * what the scanner would receive. Results are reproducible, the losses come
+ * from a seeded generator.
+ */
+
+/* demo config */
+
+/* same configurations as BENCHMARK_CONFIGURATIONS in main.cpp */
+static const struct {
+    uint16_t periodic_interval; /* in multiples of 1.25ms */
+    const char *phy;
+    /* time on air of a byte in microseconds */
+    uint32_t byte_air_time_us;
+    /* packet error rate in per mille */
+    uint32_t per_permille;
+} BENCHMARK_CONFIGURATIONS[] = {
+    { 80, "1M", 8, 10 },
+    { 24, "1M", 8, 10 },
+    { 80, "2M", 4, 20 },
+    { 24, "2M", 4, 20 },
+    { 80, "coded", 64, 2 }
+};
+static const uint32_t BENCHMARK_DURATION_US = 20000000;
+static const size_t BENCHMARK_PAYLOAD_SIZE = 252;
+
+/* the host updates the payload with a timer which drifts from the periodic
+ * events of the controller, by this much per mille, and is late by up to this
+ * much on each update */
+static const uint32_t HOST_DRIFT_PERMILLE = 3;
+static const uint32_t HOST_MAX_LATENCY_US = 2000;
+
+/* the clocks of the two devices are not synchronised */
+static const uint32_t RECEIVER_CLOCK_OFFSET_US = 123456;
+
+/* config end */
+
+static const size_t BENCHMARK_CONFIGURATION_COUNT =
+    sizeof(BENCHMARK_CONFIGURATIONS) / sizeof(BENCHMARK_CONFIGURATIONS[0]);
+
+/* largest advertising data carried by an AUX_SYNC_IND or AUX_CHAIN_IND */
+static const size_t MAX_PDU_DATA = 247;
+
+/* access address, header, extended header and CRC of a PDU, in bytes */
+static const uint32_t PDU_OVERHEAD = 4 + 2 + 3 + 3;
+
+/* time between two PDUs of a chain */
+static const uint32_t T_MAFS_US = 300;
+
+/* the HCI command updating the payload can't carry more than this */
+static const size_t MAX_HCI_DATA = 252;
+
+static uint32_t random_state = 0x2F6E2B1;
+
+static uint32_t next_random()
+{
+    /* xorshift32 */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/** Controller sending the periodic advertising train of the transmitter */
+class SimulatedController {
+public:
+    void configure(uint8_t index)
+    {
+        _index = index;
+        _payload_size = 0;
+    }
+
+    /** Set the payload sent from the next periodic event, as the HCI command would */
+    bool set_payload(const uint8_t *payload, size_t size)
+    {
+        if (size > MAX_HCI_DATA) {
+            return false;
+        }
+        memcpy(_payload, payload, size);
+        _payload_size = size;
+        return true;
+    }
+
+    /**
+     * Send the payload at a periodic event and reassemble what the scanner
+     * receives from the chain of PDUs.
+     *
+     * @param[out] received Payload reported to the scanner.
+     * @param[out] air_time_us Time from the start of the event to the end of the last PDU received.
+     *
+     * @return Size of the payload received, 0 if a PDU was lost and the report truncated.
+     */
+    size_t send_event(uint8_t *received, uint32_t &air_time_us)
+    {
+        air_time_us = 0;
+        size_t sent = 0;
+
+        do {
+            size_t chunk = _payload_size - sent;
+            if (chunk > MAX_PDU_DATA) {
+                chunk = MAX_PDU_DATA;
+            }
+
+            if (sent) {
+                air_time_us += T_MAFS_US;
+            }
+            air_time_us += (PDU_OVERHEAD + chunk) * BENCHMARK_CONFIGURATIONS[_index].byte_air_time_us;
+
+            if (next_random() % 1000 < BENCHMARK_CONFIGURATIONS[_index].per_permille) {
+                _lost_pdus++;
+                return 0;
+            }
+
+            memcpy(received + sent, _payload + sent, chunk);
+            sent += chunk;
+        } while (sent < _payload_size);
+
+        return sent;
+    }
+
+    uint32_t lost_pdus() const
+    {
+        return _lost_pdus;
+    }
+
+private:
+    uint8_t _index = 0;
+    uint8_t _payload[MAX_HCI_DATA];
+    size_t _payload_size = 0;
+    uint32_t _lost_pdus = 0;
+};
+
+static void print_results(const periodic_benchmark::Receiver::results_t &results, uint32_t truncated)
+{
+    if (results.configuration >= BENCHMARK_CONFIGURATION_COUNT) {
+        return;
+    }
+
+    printf("Benchmark interval %dms PHY %s: goodput %lu B/s, %lu frames, %lu lost, "
+           "%lu duplicates, %lu out of order, %lu corrupted, %lu truncated reports, "
+           "latency avg %luus max %luus\r\n",
+           BENCHMARK_CONFIGURATIONS[results.configuration].periodic_interval * 5 / 4,
+           BENCHMARK_CONFIGURATIONS[results.configuration].phy,
+           (unsigned long)results.goodput, (unsigned long)results.frames, (unsigned long)results.lost,
+           (unsigned long)results.duplicates, (unsigned long)results.out_of_order,
+           (unsigned long)results.corrupted, (unsigned long)truncated,
+           (unsigned long)results.latency_avg_us, (unsigned long)results.latency_max_us);
+}
+
+/** Account for the frames of a reassembled payload, as receive_benchmark_report() does */
+static void receive_payload(periodic_benchmark::Receiver &receiver, const uint8_t *payload, size_t size, uint32_t now_us)
+{
+    size_t offset = 0;
+    while (offset + 2 <= size) {
+        size_t length = payload[offset];
+        if (length == 0 || offset + 1 + length > size) {
+            return;
+        }
+        receiver.on_frame(payload[offset + 1], payload + offset + 2, length - 1, now_us);
+        offset += 1 + length;
+    }
+}
+
+int main()
+{
+    periodic_benchmark::Transmitter transmitter;
+    periodic_benchmark::Receiver receiver;
+    SimulatedController controller;
+
+    uint8_t payload[BENCHMARK_PAYLOAD_SIZE];
+    uint8_t received[MAX_HCI_DATA];
+
+    /* time of the transmitter, both devices start together */
+    uint32_t now_us = 0;
+    uint32_t truncated = 0;
+
+    for (uint8_t index = 0; index < BENCHMARK_CONFIGURATION_COUNT; ++index) {
+        uint32_t interval_us = BENCHMARK_CONFIGURATIONS[index].periodic_interval * 1250;
+        uint32_t host_period_us = interval_us + interval_us * HOST_DRIFT_PERMILLE / 1000;
+
+        printf("Benchmark configuration %d: interval %dms, PHY %s, payload %d bytes\r\n",
+               index, (int)(interval_us / 1000), BENCHMARK_CONFIGURATIONS[index].phy,
+               (int)BENCHMARK_PAYLOAD_SIZE);
+
+        controller.configure(index);
+        transmitter.reset();
+
+        uint32_t start_us = now_us;
+        uint32_t next_update_us = start_us;
+        uint32_t update_failures = 0;
+
+        /* the payload for an event has to be set before the event starts */
+        for (uint32_t event_us = start_us + interval_us;
+             event_us - start_us < BENCHMARK_DURATION_US;
+             event_us += interval_us) {
+            while (next_update_us < event_us) {
+                uint32_t update_us = next_update_us + next_random() % HOST_MAX_LATENCY_US;
+                size_t size = transmitter.build_payload(payload, sizeof(payload), index, update_us);
+                if (!controller.set_payload(payload, size)) {
+                    update_failures++;
+                }
+                next_update_us += host_period_us;
+            }
+
+            uint32_t air_time_us;
+            size_t size = controller.send_event(received, air_time_us);
+            if (!size) {
+                truncated++;
+                continue;
+            }
+
+            receive_payload(receiver, received, size, event_us + air_time_us + RECEIVER_CLOCK_OFFSET_US);
+
+            periodic_benchmark::Receiver::results_t results;
+            if (receiver.take_completed(results)) {
+                print_results(results, truncated);
+                truncated = 0;
+            }
+        }
+
+        printf("Benchmark configuration %d sent %lu frames, %lu stream bytes, %lu payload updates failed\r\n",
+               index, (unsigned long)transmitter.frames_sent(),
+               (unsigned long)transmitter.stream_bytes(), (unsigned long)update_failures);
+
+        now_us = start_us + BENCHMARK_DURATION_US;
+    }
+
+    /* the last configuration completes without the transmitter moving on */
+    print_results(receiver.results(), truncated);
+    printf("%lu PDUs lost\r\n", (unsigned long)controller.lost_pdus());
+
+    return 0;
+}
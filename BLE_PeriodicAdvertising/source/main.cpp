@@ -18,12 +18,94 @@
 #include "ble/BLE.h"
 #include "pretty_printer.h"
 #include "mbed-trace/mbed_trace.h"
+#include "periodic_benchmark.h"
+#include "periodic_collector.h"
 
 /** This example demonstrates extended and periodic advertising
  */
 
+using namespace std::chrono;
 using namespace std::literals::chrono_literals;
 
+/* demo config */
+/* you can adjust these parameters and see the effect on the performance */
+
+/* Parameters used by the scanner when it synchronises with periodic advertising.
+ * The skip is the number of periodic advertising packets the controller may skip
+ * after a successful receive, the timeout is the time after which the sync is
+ * considered lost if no packet was received. */
+static const uint16_t SYNC_MAX_PACKET_SKIP = 2;
+static const ble::sync_timeout_t SYNC_TIMEOUT(ble::millisecond_t(5000));
+
+/* When the periodic-sync-tuning option is enabled in mbed_app.json the scanner
+ * measures each of these skip values for the measurement window then keeps the
+ * one with the lowest radio on time that reaches the target delivery ratio of
+ * the payload updates (in per mille). The sync timeout of each configuration
+ * covers this many listening opportunities. */
+static const uint16_t TUNING_SKIPS[] = { 0, 1, 2, 4, 8, 16 };
+static const std::chrono::milliseconds TUNING_WINDOW = 30000ms;
+static const uint32_t TUNING_TARGET_DELIVERY_PERMILLE = 950;
+static const uint32_t TUNING_TIMEOUT_LISTENS = 6;
+
+/* When the sync is lost the scanner first tries to resync directly with the train
+ * it was synced with, using the periodic advertiser list and a scan bounded to a
+ * few periodic intervals. After this many failed targeted attempts it falls back
+ * to an unbounded scan for any periodic advertiser. */
+static const uint8_t MAX_TARGETED_RESYNC_ATTEMPTS = 3;
+static const uint32_t RESYNC_SCAN_PERIODIC_INTERVALS = 4;
+
+/* Periodic interval used by the advertiser, in multiples of 1.25ms. When the
+ * adaptive-periodic-interval option is enabled in mbed_app.json the advertiser
+ * switches between the fast and slow profile depending on how often the
+ * published value changes, otherwise the default profile is used. */
+static const ble::periodic_interval_t DEFAULT_PERIODIC_INTERVAL_MIN(100);
+static const ble::periodic_interval_t DEFAULT_PERIODIC_INTERVAL_MAX(1000);
+static const ble::periodic_interval_t FAST_PERIODIC_INTERVAL_MIN(80);
+static const ble::periodic_interval_t FAST_PERIODIC_INTERVAL_MAX(100);
+static const ble::periodic_interval_t SLOW_PERIODIC_INTERVAL_MIN(800);
+static const ble::periodic_interval_t SLOW_PERIODIC_INTERVAL_MAX(1000);
+
+/* The rate of change is a moving average of the fraction of sensor updates that
+ * changed the value, scaled to 0-256. Above the fast threshold the fast profile
+ * is used, below the slow threshold the slow one. */
+static const uint16_t RATE_OF_CHANGE_FAST_THRESHOLD = 128;
+static const uint16_t RATE_OF_CHANGE_SLOW_THRESHOLD = 32;
+
+/* The simulated battery drains for this many sensor updates then stays still
+ * for as many, so that the published value has busy and quiet phases. */
+static const uint32_t SENSOR_ACTIVITY_PHASE = 20;
+
+/* When the periodic-benchmark option is enabled in mbed_app.json the advertiser
+ * streams numbered frames, updating the payload every periodic event, and the
+ * scanner measures what it receives. Each of these configurations of the
+ * periodic train is measured for BENCHMARK_DURATION. The payload is limited to
+ * what a single HCI command carries: the controller refuses a payload split
+ * over several commands while periodic advertising is enabled. */
+static const struct {
+    uint16_t periodic_interval; /* in multiples of 1.25ms */
+    ble::phy_t::type phy;
+} BENCHMARK_CONFIGURATIONS[] = {
+    { 80, ble::phy_t::LE_1M },
+    { 24, ble::phy_t::LE_1M },
+    { 80, ble::phy_t::LE_2M },
+    { 24, ble::phy_t::LE_2M },
+    { 80, ble::phy_t::LE_CODED }
+};
+static const std::chrono::milliseconds BENCHMARK_DURATION = 20000ms;
+static const uint16_t BENCHMARK_PAYLOAD_SIZE = 252;
+
+/* When the periodic-collector option is enabled in mbed_app.json the scanner syncs
+ * with every periodic advertiser it finds, up to collector-max-syncs, and prints
+ * the latest value of each of them with this period. */
+static const std::chrono::milliseconds COLLECTOR_DUMP_PERIOD = 10000ms;
+
+/* The controller keeps trying to sync until told to stop. The collector gives up
+ * on an advertiser after this many of its periodic intervals and looks for the
+ * other ones. */
+static const uint32_t COLLECTOR_SYNC_PERIODIC_INTERVALS = 6;
+
+/* config end */
+
 events::EventQueue event_queue;
 
 static const char DEVICE_NAME[] = "Periodic";
@@ -34,6 +116,19 @@ static const uint16_t MAX_ADVERTISING_PAYLOAD_SIZE = 50;
  */
 class PeriodicDemo : private mbed::NonCopyable<PeriodicDemo>, public ble::Gap::EventHandler
 {
+    /** Statistics of the reports received through a sync */
+    struct sync_stats_t {
+        uint32_t interval_us = 0;
+        uint32_t reports = 0;
+        uint32_t missed_events = 0;
+        uint32_t max_gap_us = 0;
+        uint32_t jitter_sum_us = 0;
+        uint32_t max_jitter_us = 0;
+        uint32_t updates_received = 0;
+        uint32_t updates_lost = 0;
+        uint16_t last_sequence = 0;
+    };
+
 public:
     PeriodicDemo(BLE& ble, events::EventQueue& event_queue) :
         _ble(ble),
@@ -55,6 +150,11 @@ public:
         /* handle gap events */
         _ble.gap().setEventHandler(this);
 
+#if MBED_CONF_APP_PERIODIC_BENCHMARK
+        /* frames carry the transmitter time, the receiver uses it for latency */
+        _benchmark_clock.start();
+#endif // MBED_CONF_APP_PERIODIC_BENCHMARK
+
         ble_error_t error = _ble.init(this, &PeriodicDemo::on_init_complete);
         if (error) {
             print_error(error, "Error returned by BLE::init\r\n");
@@ -82,6 +182,10 @@ private:
 
         print_mac_address();
 
+#if MBED_CONF_APP_PERIODIC_COLLECTOR
+        start_collector();
+#endif // MBED_CONF_APP_PERIODIC_COLLECTOR
+
         /* all calls are serialised on the user thread through the event queue */
         start_role();
     }
@@ -175,6 +279,11 @@ private:
 
         adv_parameters.setUseLegacyPDU(false);
 
+#if MBED_CONF_APP_PERIODIC_BENCHMARK
+        /* periodic advertising is sent on the secondary PHY of the set */
+        adv_parameters.setPhy(ble::phy_t::LE_1M, BENCHMARK_CONFIGURATIONS[_benchmark_index].phy);
+#endif // MBED_CONF_APP_PERIODIC_BENCHMARK
+
         ble_error_t error = _ble.gap().setAdvertisingParameters(_adv_handle, adv_parameters);
 
         if (error) {
@@ -230,22 +339,230 @@ private:
             return;
         }
 
+        _scan_timer.start();
+
         printf("Scanning for periodic advertising started\r\n");
     }
 
+    /** Try to sync again with the train we lost, fall back to a general scan after too many failures */
+    void resync()
+    {
+        if (!_train.valid || _resync_attempts >= MAX_TARGETED_RESYNC_ATTEMPTS) {
+            printf("Targeted resync failed, falling back to general scan\r\n");
+            _resync_general = true;
+            scan_periodic();
+            return;
+        }
+
+        _resync_attempts++;
+
+        /* ignore advertising reports, the controller syncs using the periodic advertiser list */
+        _is_connecting_or_syncing = true;
+
+        ble_error_t error = _ble.gap().clearPeriodicAdvertiserList();
+
+        if (error) {
+            print_error(error, "Error caused by Gap::clearPeriodicAdvertiserList\r\n");
+            abandon_targeted_resync();
+            return;
+        }
+
+        error = _ble.gap().addDeviceToPeriodicAdvertiserList(
+            _train.address_type,
+            _train.address,
+            _train.sid
+        );
+
+        if (error) {
+            print_error(error, "Error caused by Gap::addDeviceToPeriodicAdvertiserList\r\n");
+            abandon_targeted_resync();
+            return;
+        }
+
+        error = _ble.gap().createSync(_sync_skip, _sync_timeout);
+
+        if (error) {
+            print_error(error, "Error caused by Gap::createSync\r\n");
+            abandon_targeted_resync();
+            return;
+        }
+
+        /* the train is known so we only need to listen for a few of its intervals */
+        error = _ble.gap().startScan(
+            ble::scan_duration_t(ble::millisecond_t(_train.interval_ms * RESYNC_SCAN_PERIODIC_INTERVALS))
+        );
+
+        if (error) {
+            print_error(error, "Error caused by Gap::startScan\r\n");
+            _ble.gap().cancelCreateSync();
+            abandon_targeted_resync();
+            return;
+        }
+
+        _scan_timer.start();
+
+        printf("Targeted resync attempt %d with SID %d\r\n", _resync_attempts, _train.sid);
+    }
+
+    /** Skip the remaining targeted attempts and go straight to a general scan */
+    void abandon_targeted_resync()
+    {
+        _resync_attempts = MAX_TARGETED_RESYNC_ATTEMPTS;
+        _event_queue.call(this, &PeriodicDemo::resync);
+    }
+
+    /** Stop scanning and account for the time the scanner was running */
+    void stop_scan()
+    {
+        _ble.gap().stopScan();
+        _scan_timer.stop();
+    }
+
+    /** Print the cost of recovering from the last sync loss */
+    void print_resync_stats()
+    {
+        _resync_timer.stop();
+
+        int recovery_ms = duration_cast<milliseconds>(_resync_timer.elapsed_time()).count();
+        int scan_ms = duration_cast<milliseconds>(_scan_timer.elapsed_time()).count();
+
+        _resync_total_recovery_ms += recovery_ms;
+        _resync_total_scan_ms += scan_ms;
+
+        printf("Sync loss %lu recovered in %dms by %s after %d targeted attempts, "
+               "scanner on for %dms\r\n",
+               _resync_count, recovery_ms,
+               _resync_general ? "general scan" : "targeted resync",
+               _resync_attempts, scan_ms);
+        printf("Average over %lu losses: recovery %lums, scanner on for %lums\r\n",
+               _resync_count,
+               _resync_total_recovery_ms / _resync_count,
+               _resync_total_scan_ms / _resync_count);
+    }
+
+    /** Start periodic advertising with the interval of the current profile */
+    ble_error_t start_periodic_advertising()
+    {
+        ble::periodic_interval_t interval_min = DEFAULT_PERIODIC_INTERVAL_MIN;
+        ble::periodic_interval_t interval_max = DEFAULT_PERIODIC_INTERVAL_MAX;
+
+#if MBED_CONF_APP_PERIODIC_BENCHMARK
+        interval_min = ble::periodic_interval_t(BENCHMARK_CONFIGURATIONS[_benchmark_index].periodic_interval);
+        interval_max = interval_min;
+#elif MBED_CONF_APP_ADAPTIVE_PERIODIC_INTERVAL
+        interval_min = _fast_profile ? FAST_PERIODIC_INTERVAL_MIN : SLOW_PERIODIC_INTERVAL_MIN;
+        interval_max = _fast_profile ? FAST_PERIODIC_INTERVAL_MAX : SLOW_PERIODIC_INTERVAL_MAX;
+#endif
+
+        ble_error_t error = _ble.gap().setPeriodicAdvertisingParameters(
+            _adv_handle,
+            interval_min,
+            interval_max
+        );
+
+        if (error) {
+            print_error(error, "Gap::setPeriodicAdvertisingParameters() failed\r\n");
+            return error;
+        }
+
+        error = _ble.gap().startPeriodicAdvertising(_adv_handle);
+
+        if (error) {
+            print_error(error, "Gap::startPeriodicAdvertising() failed\r\n");
+        }
+
+        return error;
+    }
+
+#if MBED_CONF_APP_ADAPTIVE_PERIODIC_INTERVAL
+    /** Track how often the value changes and move to the matching interval profile */
+    void update_interval_profile(bool value_changed)
+    {
+        _rate_of_change -= _rate_of_change / 8;
+        if (value_changed) {
+            _rate_of_change += 256 / 8;
+        }
+
+        bool fast_profile = _fast_profile;
+        if (_rate_of_change > RATE_OF_CHANGE_FAST_THRESHOLD) {
+            fast_profile = true;
+        } else if (_rate_of_change < RATE_OF_CHANGE_SLOW_THRESHOLD) {
+            fast_profile = false;
+        }
+
+        if (fast_profile == _fast_profile) {
+            return;
+        }
+
+        /* the interval can only be changed while periodic advertising is disabled */
+        ble_error_t error = _ble.gap().stopPeriodicAdvertising(_adv_handle);
+
+        if (error) {
+            print_error(error, "Gap::stopPeriodicAdvertising() failed\r\n");
+            return;
+        }
+
+        _fast_profile = fast_profile;
+
+        /* stop, set parameters and start */
+        _profile_commands += 3;
+
+        if (start_periodic_advertising()) {
+            /* keep the train running with the profile it had */
+            _fast_profile = !fast_profile;
+            _profile_commands += 2;
+            if (start_periodic_advertising()) {
+                printf("Periodic advertising stopped, failed to restore the %s periodic interval\r\n",
+                       _fast_profile ? "fast" : "slow");
+            }
+            return;
+        }
+
+        _interval_changes++;
+
+        printf("Rate of change %d/256, switched to %s periodic interval, "
+               "%lu interval changes, %lu payload updates saved for %lu commands spent\r\n",
+               _rate_of_change, _fast_profile ? "fast" : "slow",
+               _interval_changes, _skipped_payload_updates, _profile_commands);
+    }
+#endif // MBED_CONF_APP_ADAPTIVE_PERIODIC_INTERVAL
+
     /* also updates periodic advertising payload */
     void update_sensor_value()
     {
-        /* simulate battery level */
-        _battery_level--;
-        if (_battery_level < 1) {
-            _battery_level = 100;
+        /* simulate battery level, it drains in bursts separated by quiet phases */
+        _sensor_updates++;
+        bool value_changed = ((_sensor_updates / SENSOR_ACTIVITY_PHASE) % 2) == 0;
+
+        if (value_changed) {
+            _battery_level--;
+            if (_battery_level < 1) {
+                _battery_level = 100;
+            }
         }
 
-        /* update the level in the payload */
+#if MBED_CONF_APP_ADAPTIVE_PERIODIC_INTERVAL
+        update_interval_profile(value_changed);
+
+        /* the controller already has this value */
+        if (!value_changed) {
+            _skipped_payload_updates++;
+            return;
+        }
+#endif // MBED_CONF_APP_ADAPTIVE_PERIODIC_INTERVAL
+
+        /* update the level in the payload, it is followed by the sequence
+         * number of the update so receivers can detect the ones they missed */
+        _payload_sequence++;
+        const uint8_t service_data[] = {
+            _battery_level,
+            static_cast<uint8_t>(_payload_sequence),
+            static_cast<uint8_t>(_payload_sequence >> 8)
+        };
+
         ble_error_t error = _adv_data_builder.setServiceData(
             GattService::UUID_BATTERY_SERVICE,
-            mbed::make_Span(&_battery_level, 1)
+            mbed::make_Span(service_data, sizeof(service_data))
         );
 
         if (error) {
@@ -272,28 +589,21 @@ private:
     {
         /* start periodic advertising only if we're already advertising after roles established */
         if (_role_established) {
-            ble_error_t error = _ble.gap().setPeriodicAdvertisingParameters(
-                _adv_handle,
-                ble::periodic_interval_t(100),
-                ble::periodic_interval_t(1000)
-            );
-
-            if (error) {
-                print_error(error, "Gap::setPeriodicAdvertisingParameters() failed\r\n");
-                return;
-            }
-
-            error = _ble.gap().startPeriodicAdvertising(_adv_handle);
-
-            if (error) {
-                print_error(error, "Gap::startPeriodicAdvertising() failed\r\n");
+            if (start_periodic_advertising()) {
                 return;
             }
 
             printf("Periodic advertising started\r\n");
 
+            /* advertising is restarted when the benchmark changes configuration */
+            _event_queue.cancel(_payload_update_event);
+
+#if MBED_CONF_APP_PERIODIC_BENCHMARK
+            start_benchmark_configuration();
+#else
             /* tick over our fake battery data, this will also update the advertising payload */
-            _event_queue.call_every(1000ms, this, &PeriodicDemo::update_sensor_value);
+            _payload_update_event = _event_queue.call_every(1000ms, this, &PeriodicDemo::update_sensor_value);
+#endif // MBED_CONF_APP_PERIODIC_BENCHMARK
         }
     }
 
@@ -305,8 +615,9 @@ private:
             return;
         }
 
-        /* if we're looking for periodic advertising don't bother unless it's present */
-        if (_role_established && !event.isPeriodicIntervalPresent()) {
+        /* if we're looking for periodic advertising don't bother unless it's present,
+         * the collector also connects to peers still looking for their role */
+        if (_role_established && !event.isPeriodicIntervalPresent() && !MBED_CONF_APP_PERIODIC_COLLECTOR) {
             return;
         }
 
@@ -320,8 +631,15 @@ private:
             if (field.type == ble::adv_data_type_t::COMPLETE_LOCAL_NAME &&
                 field.value.size() == strlen(DEVICE_NAME) &&
                 (memcmp(field.value.data(), DEVICE_NAME, field.value.size()) == 0)) {
+#if MBED_CONF_APP_PERIODIC_COLLECTOR
+                if (event.isPeriodicIntervalPresent() &&
+                    (_collector.full() || _collector.contains(event.getPeerAddress().data(), event.getSID()))) {
+                    return;
+                }
+#endif // MBED_CONF_APP_PERIODIC_COLLECTOR
+
                 /* if we haven't established our roles connect, otherwise sync with advertising */
-                if (_role_established) {
+                if (_role_established && event.isPeriodicIntervalPresent()) {
                     printf("We found the peer, syncing with SID %d"
                            " and periodic interval %dms\r\n",
                            event.getSID(), event.getPeriodicInterval().valueInMs());
@@ -330,14 +648,22 @@ private:
                         event.getPeerAddressType(),
                         event.getPeerAddress(),
                         event.getSID(),
-                        2,
-                        ble::sync_timeout_t(ble::millisecond_t(5000))
+                        _sync_skip,
+                        _sync_timeout
                     );
 
                     if (error) {
                         print_error(error, "Error caused by Gap::createSync\r\n");
                         return;
                     }
+
+#if MBED_CONF_APP_PERIODIC_COLLECTOR
+                    _collector_sync_event = _event_queue.call_in(
+                        milliseconds(event.getPeriodicInterval().valueInMs() * COLLECTOR_SYNC_PERIODIC_INTERVALS),
+                        this,
+                        &PeriodicDemo::collector_sync_timeout
+                    );
+#endif // MBED_CONF_APP_PERIODIC_COLLECTOR
                 } else {
                     printf("We found the peer, connecting\r\n");
 
@@ -366,6 +692,12 @@ private:
     void onAdvertisingEnd(const ble::AdvertisingEndEvent &event) override
     {
         printf("Advertising ended.\r\n");
+        if (_is_reconfiguring) {
+            /* advertising is being restarted with new parameters */
+            _is_reconfiguring = false;
+            return;
+        }
+
         if (!event.isConnected()) {
             printf("No device connected to us, switch modes.\r\n");
             start_role();
@@ -375,6 +707,17 @@ private:
     void onScanTimeout(const ble::ScanTimeoutEvent&) override
     {
         printf("Scanning ended\r\n");
+        _scan_timer.stop();
+
+        /* targeted resync didn't find the train, cancelling the sync will report a failure */
+        if (_is_resyncing && !_resync_general) {
+            ble_error_t error = _ble.gap().cancelCreateSync();
+            if (error) {
+                _event_queue.call(this, &PeriodicDemo::resync);
+            }
+            return;
+        }
+
         if (!_is_connecting_or_syncing) {
             printf("Failed to find peer\r\n");
             start_role();
@@ -420,17 +763,74 @@ private:
     /** Called when first advertising packet in periodic advertising is received. */
     void onPeriodicAdvertisingSyncEstablished(const ble::PeriodicAdvertisingSyncEstablishedEvent &event) override
     {
+#if MBED_CONF_APP_PERIODIC_COLLECTOR
+        collector_sync_established(event);
+        return;
+#endif // MBED_CONF_APP_PERIODIC_COLLECTOR
+
         if (event.getStatus() == BLE_ERROR_NONE) {
             printf("Synced with periodic advertising\r\n");
             _sync_handle = event.getSyncHandle();
+
+            /* remember the train so we can resync quickly if we lose it */
+            _train.address_type = event.getPeerAddressType();
+            _train.address = event.getPeerAddress();
+            _train.sid = event.getSid();
+            _train.interval_ms = event.getAdvertisingInterval().valueInMs();
+            _train.valid = true;
+
+            /* reports come through the sync, no need to keep the scanner running */
+            stop_scan();
+
+            if (_is_resyncing) {
+                _is_resyncing = false;
+                if (_resync_after_loss) {
+                    print_resync_stats();
+                }
+            }
+
+            /* statistics are kept per sync */
+            _sync_stats = sync_stats_t();
+            _sync_stats.interval_us = event.getAdvertisingInterval().value() * 1250;
+            _sync_timer.reset();
+            _sync_timer.start();
+            _report_timer.reset();
+            _report_timer.start();
+
+#if MBED_CONF_APP_PERIODIC_SYNC_TUNING
+            /* a sync lost cancels the window, the measure restarts with the new sync */
+            if (!_tuning_window_event && _tuning_index < TUNING_CONFIGURATIONS) {
+                _tuning_window_event = _event_queue.call_in(TUNING_WINDOW, this, &PeriodicDemo::end_tuning_window);
+            }
+#endif // MBED_CONF_APP_PERIODIC_SYNC_TUNING
         } else {
             printf("Sync with periodic advertising failed\r\n");
+
+            if (_is_resyncing && !_resync_general) {
+                stop_scan();
+                _event_queue.call(this, &PeriodicDemo::resync);
+            } else {
+                /* let the scan look for the train again */
+                _is_connecting_or_syncing = false;
+            }
         }
     }
 
     /** Called when a periodic advertising packet is received. */
     void onPeriodicAdvertisingReport(const ble::PeriodicAdvertisingReportEvent &event) override
     {
+#if MBED_CONF_APP_PERIODIC_BENCHMARK
+        receive_benchmark_report(event);
+        return;
+#endif // MBED_CONF_APP_PERIODIC_BENCHMARK
+
+#if MBED_CONF_APP_PERIODIC_COLLECTOR
+        collect_report(event);
+        return;
+#endif // MBED_CONF_APP_PERIODIC_COLLECTOR
+
+        int report_gap_ms = record_report_timing();
+
         ble::AdvertisingDataParser adv_parser(event.getPayload());
 
         /* parse the advertising payload, looking for a battery level */
@@ -442,20 +842,476 @@ private:
                 if (*((uint16_t*)field.value.data()) != GattService::UUID_BATTERY_SERVICE) {
                     printf("Unexpected service data\r\n");
                 } else {
-                    /* battery level is right after the UUID */
+                    /* battery level is right after the UUID, followed by the sequence number */
                     const uint8_t *battery_level = field.value.data() + sizeof(uint16_t);
-                    printf("Peer battery level: %d\r\n", *battery_level);
+                    if (field.value.size() >= sizeof(uint16_t) + 3) {
+                        record_sequence(battery_level[1] | (battery_level[2] << 8));
+                    }
+                    print_battery_level(*battery_level, report_gap_ms);
                 }
             }
         }
     }
 
+    /**
+     * Account for a received report against the periodic interval of the sync.
+     *
+     * @return Time elapsed since the previous report in milliseconds.
+     */
+    int record_report_timing()
+    {
+        uint32_t gap_us = duration_cast<microseconds>(_report_timer.elapsed_time()).count();
+        _report_timer.reset();
+        _report_timer.start();
+
+        sync_stats_t &stats = _sync_stats;
+        stats.reports++;
+
+        if (stats.reports > 1 && stats.interval_us) {
+            /* number of periodic events since the previous report, the ones in between were missed */
+            uint32_t events = (gap_us + stats.interval_us / 2) / stats.interval_us;
+            if (events == 0) {
+                events = 1;
+            }
+            stats.missed_events += events - 1;
+
+            uint32_t expected_us = events * stats.interval_us;
+            uint32_t jitter_us = gap_us > expected_us ? gap_us - expected_us : expected_us - gap_us;
+            stats.jitter_sum_us += jitter_us;
+            if (jitter_us > stats.max_jitter_us) {
+                stats.max_jitter_us = jitter_us;
+            }
+            if (gap_us > stats.max_gap_us) {
+                stats.max_gap_us = gap_us;
+            }
+        }
+
+        return gap_us / 1000;
+    }
+
+    /** Account for the sequence number of the payload update carried by a report */
+    void record_sequence(uint16_t sequence)
+    {
+        sync_stats_t &stats = _sync_stats;
+
+        if (!stats.updates_received) {
+            stats.updates_received = 1;
+        } else if (sequence != stats.last_sequence) {
+            stats.updates_received++;
+            /* sequence numbers wrap around */
+            stats.updates_lost += static_cast<uint16_t>(sequence - stats.last_sequence) - 1;
+        }
+
+        stats.last_sequence = sequence;
+    }
+
+    /** Delivery ratio of the payload updates in per mille */
+    static uint32_t delivery_permille(const sync_stats_t &stats)
+    {
+        uint32_t published = stats.updates_received + stats.updates_lost;
+        return published ? (stats.updates_received * 1000) / published : 0;
+    }
+
+    /**
+     * Fraction of the periodic events the radio received in per mille. With no loss
+     * this is 1 / (skip + 1) so it tracks the time the radio is on for the sync.
+     */
+    static uint32_t radio_on_permille(const sync_stats_t &stats)
+    {
+        uint32_t events = stats.reports + stats.missed_events;
+        return events ? (stats.reports * 1000) / events : 0;
+    }
+
+    /** Print loss, gap and jitter statistics of the current sync */
+    void print_sync_stats()
+    {
+        const sync_stats_t &stats = _sync_stats;
+        uint32_t intervals = stats.reports > 1 ? stats.reports - 1 : 1;
+
+        printf("skip %d, timeout %dms: delivery %lu/1000, radio on %lu/1000, "
+               "%lu reports, %lu missed events, %lu updates lost, "
+               "max gap %lums, jitter avg %luus max %luus over %dms\r\n",
+               _sync_skip, (int)_sync_timeout.valueInMs(),
+               delivery_permille(stats), radio_on_permille(stats),
+               stats.reports, stats.missed_events, stats.updates_lost,
+               stats.max_gap_us / 1000, stats.jitter_sum_us / intervals, stats.max_jitter_us,
+               (int)duration_cast<milliseconds>(_sync_timer.elapsed_time()).count());
+    }
+
+#if MBED_CONF_APP_PERIODIC_SYNC_TUNING
+    /** Record the result of the configuration being measured and move to the next one */
+    void end_tuning_window()
+    {
+        _tuning_window_event = 0;
+
+        if (_tuning_index >= TUNING_CONFIGURATIONS) {
+            return;
+        }
+
+        print_sync_stats();
+
+        _tuning_delivery[_tuning_index] = delivery_permille(_sync_stats);
+        _tuning_radio_on[_tuning_index] = radio_on_permille(_sync_stats);
+        _tuning_index++;
+
+        size_t next = _tuning_index;
+
+        if (_tuning_index == TUNING_CONFIGURATIONS) {
+            /* cheapest configuration reaching the target, most reliable one otherwise */
+            next = 0;
+            bool target_reached = false;
+            for (size_t i = 0; i < TUNING_CONFIGURATIONS; ++i) {
+                bool reached = _tuning_delivery[i] >= TUNING_TARGET_DELIVERY_PERMILLE;
+                if (reached && (!target_reached || _tuning_radio_on[i] < _tuning_radio_on[next])) {
+                    next = i;
+                } else if (!target_reached && !reached && _tuning_delivery[i] > _tuning_delivery[next]) {
+                    next = i;
+                }
+                target_reached |= reached;
+            }
+
+            printf("Selected skip %d, delivery %lu/1000, radio on %lu/1000%s\r\n",
+                   TUNING_SKIPS[next], _tuning_delivery[next], _tuning_radio_on[next],
+                   target_reached ? "" : " (target not reached)");
+        }
+
+        apply_sync_configuration(TUNING_SKIPS[next]);
+    }
+
+    /** Restart the sync with a new skip and a timeout matching it */
+    void apply_sync_configuration(uint16_t skip)
+    {
+        uint32_t timeout_ms = _train.interval_ms * (skip + 1) * TUNING_TIMEOUT_LISTENS;
+        if (timeout_ms < ble::sync_timeout_t::min().valueInMs()) {
+            timeout_ms = ble::sync_timeout_t::min().valueInMs();
+        } else if (timeout_ms > ble::sync_timeout_t::max().valueInMs()) {
+            timeout_ms = ble::sync_timeout_t::max().valueInMs();
+        }
+
+        _sync_skip = skip;
+        _sync_timeout = ble::sync_timeout_t(ble::millisecond_t(timeout_ms));
+
+        if (_sync_handle != ble::INVALID_ADVERTISING_HANDLE) {
+            _ble.gap().terminateSync(_sync_handle);
+            _sync_handle = ble::INVALID_ADVERTISING_HANDLE;
+        }
+
+        /* go through the targeted resync without accounting it as a loss */
+        _is_resyncing = true;
+        _resync_after_loss = false;
+        _resync_general = false;
+        _resync_attempts = 0;
+        _scan_timer.reset();
+
+        _event_queue.call(this, &PeriodicDemo::resync);
+    }
+#endif // MBED_CONF_APP_PERIODIC_SYNC_TUNING
+
+#if MBED_CONF_APP_PERIODIC_BENCHMARK
+    static const char *phy_name(ble::phy_t::type phy)
+    {
+        switch (phy) {
+            case ble::phy_t::LE_1M:
+                return "1M";
+            case ble::phy_t::LE_2M:
+                return "2M";
+            case ble::phy_t::LE_CODED:
+                return "coded";
+            default:
+                return "unknown";
+        }
+    }
+
+    static bool is_phy_supported(BLE &ble, ble::phy_t::type phy)
+    {
+        switch (phy) {
+            case ble::phy_t::LE_2M:
+                return ble.gap().isFeatureSupported(ble::controller_supported_features_t::LE_2M_PHY);
+            case ble::phy_t::LE_CODED:
+                return ble.gap().isFeatureSupported(ble::controller_supported_features_t::LE_CODED_PHY);
+            default:
+                return true;
+        }
+    }
+
+    uint32_t benchmark_time_us()
+    {
+        return duration_cast<microseconds>(_benchmark_clock.elapsed_time()).count();
+    }
+
+    /** Stream frames in the configuration set in the periodic advertising train */
+    void start_benchmark_configuration()
+    {
+        _benchmark_payload_size = BENCHMARK_PAYLOAD_SIZE;
+        if (_benchmark_payload_size > _ble.gap().getMaxAdvertisingDataLength()) {
+            _benchmark_payload_size = _ble.gap().getMaxAdvertisingDataLength();
+        }
+
+        ble::periodic_interval_t interval(BENCHMARK_CONFIGURATIONS[_benchmark_index].periodic_interval);
+
+        printf("Benchmark configuration %d: interval %dms, PHY %s, payload %d bytes\r\n",
+               _benchmark_index, (int)interval.valueInMs(),
+               phy_name(BENCHMARK_CONFIGURATIONS[_benchmark_index].phy), _benchmark_payload_size);
+
+        _benchmark_transmitter.reset();
+
+        /* a new payload for every periodic event */
+        _payload_update_event = _event_queue.call_every(
+            milliseconds(interval.valueInMs()),
+            this,
+            &PeriodicDemo::send_benchmark_payload
+        );
+        _event_queue.call_in(BENCHMARK_DURATION, this, &PeriodicDemo::next_benchmark_configuration);
+    }
+
+    void send_benchmark_payload()
+    {
+        size_t size = _benchmark_transmitter.build_payload(
+            _benchmark_buffer,
+            _benchmark_payload_size,
+            _benchmark_index,
+            benchmark_time_us()
+        );
+
+        ble_error_t error = _ble.gap().setPeriodicAdvertisingPayload(
+            _adv_handle,
+            mbed::make_const_Span(_benchmark_buffer, size)
+        );
+
+        if (error) {
+            _benchmark_send_errors++;
+        }
+    }
+
+    /** Restart advertising in the next configuration the controller supports */
+    void next_benchmark_configuration()
+    {
+        _event_queue.cancel(_payload_update_event);
+
+        printf("Benchmark configuration %d sent %lu frames, %lu stream bytes, %lu payload updates failed\r\n",
+               _benchmark_index, _benchmark_transmitter.frames_sent(),
+               _benchmark_transmitter.stream_bytes(), _benchmark_send_errors);
+        _benchmark_send_errors = 0;
+
+        do {
+            _benchmark_index = (_benchmark_index + 1) % BENCHMARK_CONFIGURATION_COUNT;
+        } while (!is_phy_supported(_ble, BENCHMARK_CONFIGURATIONS[_benchmark_index].phy));
+
+        /* parameters of the set can't change while it is advertising */
+        _ble.gap().stopPeriodicAdvertising(_adv_handle);
+        _is_reconfiguring = true;
+        _ble.gap().stopAdvertising(_adv_handle);
+
+        advertise_periodic();
+    }
+
+    /** Reassemble the periodic advertising payload and account for the frames it contains */
+    void receive_benchmark_report(const ble::PeriodicAdvertisingReportEvent &event)
+    {
+        uint32_t now_us = benchmark_time_us();
+        mbed::Span<const uint8_t> payload = event.getPayload();
+
+        if (event.getDataStatus() == ble::periodic_advertising_data_status_t::INCOMPLETE_DATA_TRUNCATED ||
+            _benchmark_rx_size + payload.size() > sizeof(_benchmark_buffer)) {
+            _benchmark_truncated++;
+            _benchmark_rx_size = 0;
+            return;
+        }
+
+        memcpy(_benchmark_buffer + _benchmark_rx_size, payload.data(), payload.size());
+        _benchmark_rx_size += payload.size();
+
+        if (event.getDataStatus() == ble::periodic_advertising_data_status_t::INCOMPLETE_MORE_DATA) {
+            return;
+        }
+
+        ble::AdvertisingDataParser adv_parser(mbed::make_const_Span(_benchmark_buffer, _benchmark_rx_size));
+        _benchmark_rx_size = 0;
+
+        while (adv_parser.hasNext()) {
+            ble::AdvertisingDataParser::element_t field = adv_parser.next();
+            _benchmark_receiver.on_frame(field.type.value(), field.value.data(), field.value.size(), now_us);
+        }
+
+        periodic_benchmark::Receiver::results_t results;
+        if (_benchmark_receiver.take_completed(results)) {
+            print_benchmark_results(results);
+        }
+    }
+
+    void print_benchmark_results(const periodic_benchmark::Receiver::results_t &results)
+    {
+        if (results.configuration >= BENCHMARK_CONFIGURATION_COUNT) {
+            return;
+        }
+
+        ble::periodic_interval_t interval(BENCHMARK_CONFIGURATIONS[results.configuration].periodic_interval);
+
+        printf("Benchmark interval %dms PHY %s: goodput %lu B/s, %lu frames, %lu lost, "
+               "%lu duplicates, %lu out of order, %lu corrupted, %lu truncated reports, "
+               "latency avg %luus max %luus\r\n",
+               (int)interval.valueInMs(), phy_name(BENCHMARK_CONFIGURATIONS[results.configuration].phy),
+               results.goodput, results.frames, results.lost,
+               results.duplicates, results.out_of_order, results.corrupted, _benchmark_truncated,
+               results.latency_avg_us, results.latency_max_us);
+
+        _benchmark_truncated = 0;
+    }
+#endif // MBED_CONF_APP_PERIODIC_BENCHMARK
+
+#if MBED_CONF_APP_PERIODIC_COLLECTOR
+    /** Stay a scanner and collect values from all the periodic advertisers found */
+    void start_collector()
+    {
+        _role_established = true;
+        _is_scanner = true;
+
+        ble::ScanParameters scan_params;
+        scan_params.setOwnAddressType(ble::own_address_type_t::RANDOM);
+
+        ble_error_t error = _ble.gap().setScanParameters(scan_params);
+
+        if (error) {
+            print_error(error, "Error caused by Gap::setScanParameters\r\n");
+        }
+
+        _collector_clock.start();
+        _event_queue.call_every(COLLECTOR_DUMP_PERIOD, this, &PeriodicDemo::dump_collector);
+
+        printf("Collecting from up to %d periodic advertisers\r\n", MBED_CONF_APP_COLLECTOR_MAX_SYNCS);
+    }
+
+    void collector_sync_established(const ble::PeriodicAdvertisingSyncEstablishedEvent &event)
+    {
+        _event_queue.cancel(_collector_sync_event);
+        _collector_sync_event = 0;
+
+        /* scanning goes on, we're ready to sync with the next advertiser */
+        _is_connecting_or_syncing = false;
+
+        if (event.getStatus() != BLE_ERROR_NONE) {
+            printf("Sync with periodic advertising failed\r\n");
+            if (_collector_sync_cancelled) {
+                _collector_sync_cancelled = false;
+                restart_collector_scan();
+            }
+            return;
+        }
+
+        if (!_collector.add(event.getSyncHandle(), event.getPeerAddress().data(), event.getSid())) {
+            printf("Collector table full, dropping sync %d\r\n", event.getSyncHandle());
+            _ble.gap().terminateSync(event.getSyncHandle());
+            return;
+        }
+
+        printf("Collecting from sync %d, %d advertisers\r\n", event.getSyncHandle(), _collector.size());
+    }
+
+    /** The advertiser didn't sync in time, stop trying so that the others can be collected */
+    void collector_sync_timeout()
+    {
+        _collector_sync_event = 0;
+        printf("Sync with periodic advertising timed out\r\n");
+
+        /* cancelling the sync will report a failure */
+        ble_error_t error = _ble.gap().cancelCreateSync();
+        if (error) {
+            print_error(error, "Error caused by Gap::cancelCreateSync\r\n");
+            restart_collector_scan();
+            return;
+        }
+
+        _collector_sync_cancelled = true;
+    }
+
+    /** Scan again so that the advertisers are reported again, the one that failed included */
+    void restart_collector_scan()
+    {
+        stop_scan();
+        scan_periodic();
+    }
+
+    /** Record the battery level of a report, the cost doesn't depend on the number of advertisers */
+    void collect_report(const ble::PeriodicAdvertisingReportEvent &event)
+    {
+        ble::AdvertisingDataParser adv_parser(event.getPayload());
+
+        while (adv_parser.hasNext()) {
+            ble::AdvertisingDataParser::element_t field = adv_parser.next();
+
+            if (field.type == ble::adv_data_type_t::SERVICE_DATA &&
+                field.value.size() > sizeof(uint16_t) &&
+                *((uint16_t*)field.value.data()) == GattService::UUID_BATTERY_SERVICE) {
+                uint32_t now_ms = duration_cast<milliseconds>(_collector_clock.elapsed_time()).count();
+                _collector.update(event.getSyncHandle(), field.value[sizeof(uint16_t)], now_ms);
+                return;
+            }
+        }
+    }
+
+    /** Print sync handle, value, age and report count of every advertiser on one line */
+    void dump_collector()
+    {
+        uint32_t now_ms = duration_cast<milliseconds>(_collector_clock.elapsed_time()).count();
+
+        printf("Collected %d:", _collector.size());
+        for (size_t i = 0; i < _collector.size(); ++i) {
+            printf(" %d=%d/%lums/%lu",
+                   _collector.sync_handle(i), _collector.value(i),
+                   now_ms - _collector.timestamp_ms(i), _collector.reports(i));
+        }
+        printf("\r\n");
+    }
+#endif // MBED_CONF_APP_PERIODIC_COLLECTOR
+
+    /** Print the peer battery level when it changes along with how stale it may have been */
+    void print_battery_level(uint8_t battery_level, int report_gap_ms)
+    {
+        /* the change happened at most one report gap before we received it */
+        if (battery_level == _peer_battery_level) {
+            return;
+        }
+
+        _peer_battery_level = battery_level;
+        if (report_gap_ms > _max_report_gap_ms) {
+            _max_report_gap_ms = report_gap_ms;
+        }
+
+        printf("Peer battery level: %d (staleness up to %dms, worst %dms)\r\n",
+               battery_level, report_gap_ms, _max_report_gap_ms);
+    }
+
     /** Called when a periodic advertising sync has been lost. */
     void onPeriodicAdvertisingSyncLoss(const ble::PeriodicAdvertisingSyncLoss &event) override
     {
         printf("Sync to periodic advertising lost\r\n");
+
+#if MBED_CONF_APP_PERIODIC_COLLECTOR
+        /* the collector keeps scanning and will sync again when it finds the advertiser */
+        _collector.remove(event.getSyncHandle());
+        return;
+#endif // MBED_CONF_APP_PERIODIC_COLLECTOR
+
         _sync_handle = ble::INVALID_ADVERTISING_HANDLE;
-        _event_queue.call(this, &PeriodicDemo::scan_periodic);
+        print_sync_stats();
+
+#if MBED_CONF_APP_PERIODIC_SYNC_TUNING
+        /* the statistics of the window are lost with the sync */
+        _event_queue.cancel(_tuning_window_event);
+        _tuning_window_event = 0;
+#endif // MBED_CONF_APP_PERIODIC_SYNC_TUNING
+
+        /* measure how long and how much scanning it takes to get the sync back */
+        _is_resyncing = true;
+        _resync_after_loss = true;
+        _resync_general = false;
+        _resync_attempts = 0;
+        _resync_count++;
+        _resync_timer.reset();
+        _resync_timer.start();
+        _scan_timer.reset();
+
+        _event_queue.call(this, &PeriodicDemo::resync);
     }
 
 private:
@@ -468,7 +1324,92 @@ private:
     ble::advertising_handle_t _adv_handle = ble::INVALID_ADVERTISING_HANDLE;
     ble::periodic_sync_handle_t _sync_handle = ble::INVALID_ADVERTISING_HANDLE;
 
+    /** Last periodic advertising train we were synced with */
+    struct {
+        ble::peer_address_type_t address_type = ble::peer_address_type_t::PUBLIC;
+        ble::address_t address;
+        ble::advertising_sid_t sid = 0;
+        uint32_t interval_ms = 0;
+        bool valid = false;
+    } _train;
+
+    /* sync parameters, they change when tuning */
+#if MBED_CONF_APP_PERIODIC_BENCHMARK
+    /* the benchmark wants every periodic event */
+    uint16_t _sync_skip = 0;
+#else
+    uint16_t _sync_skip = SYNC_MAX_PACKET_SKIP;
+#endif // MBED_CONF_APP_PERIODIC_BENCHMARK
+    ble::sync_timeout_t _sync_timeout = SYNC_TIMEOUT;
+
+    /* loss, gap and jitter statistics of the current sync */
+    sync_stats_t _sync_stats;
+    Timer _sync_timer;
+
+#if MBED_CONF_APP_PERIODIC_SYNC_TUNING
+    static const size_t TUNING_CONFIGURATIONS = sizeof(TUNING_SKIPS) / sizeof(TUNING_SKIPS[0]);
+    size_t _tuning_index = 0;
+    int _tuning_window_event = 0;
+    uint32_t _tuning_delivery[TUNING_CONFIGURATIONS] = {};
+    uint32_t _tuning_radio_on[TUNING_CONFIGURATIONS] = {};
+#endif // MBED_CONF_APP_PERIODIC_SYNC_TUNING
+
+    /* sync loss recovery state and statistics */
+    bool _is_resyncing = false;
+    bool _resync_after_loss = false;
+    bool _resync_general = false;
+    uint8_t _resync_attempts = 0;
+    uint32_t _resync_count = 0;
+    uint32_t _resync_total_recovery_ms = 0;
+    uint32_t _resync_total_scan_ms = 0;
+    Timer _resync_timer;
+    Timer _scan_timer;
+
+    /* event updating the periodic advertising payload */
+    int _payload_update_event = 0;
+    bool _is_reconfiguring = false;
+
+#if MBED_CONF_APP_PERIODIC_BENCHMARK
+    static const size_t BENCHMARK_CONFIGURATION_COUNT =
+        sizeof(BENCHMARK_CONFIGURATIONS) / sizeof(BENCHMARK_CONFIGURATIONS[0]);
+
+    /* payload being sent by the transmitter or reassembled by the receiver */
+    uint8_t _benchmark_buffer[BENCHMARK_PAYLOAD_SIZE];
+    size_t _benchmark_payload_size = 0;
+    size_t _benchmark_rx_size = 0;
+    uint8_t _benchmark_index = 0;
+    uint32_t _benchmark_send_errors = 0;
+    uint32_t _benchmark_truncated = 0;
+    periodic_benchmark::Transmitter _benchmark_transmitter;
+    periodic_benchmark::Receiver _benchmark_receiver;
+    Timer _benchmark_clock;
+#endif // MBED_CONF_APP_PERIODIC_BENCHMARK
+
+#if MBED_CONF_APP_PERIODIC_COLLECTOR
+    PeriodicCollectorTable<MBED_CONF_APP_COLLECTOR_MAX_SYNCS> _collector;
+    Timer _collector_clock;
+    /* event giving up on the sync being created */
+    int _collector_sync_event = 0;
+    bool _collector_sync_cancelled = false;
+#endif // MBED_CONF_APP_PERIODIC_COLLECTOR
+
     uint8_t _battery_level = 100;
+    uint16_t _payload_sequence = 0;
+    uint32_t _sensor_updates = 0;
+
+#if MBED_CONF_APP_ADAPTIVE_PERIODIC_INTERVAL
+    /* adaptive interval state and statistics */
+    bool _fast_profile = true;
+    uint16_t _rate_of_change = 256;
+    uint32_t _interval_changes = 0;
+    uint32_t _skipped_payload_updates = 0;
+    uint32_t _profile_commands = 0;
+#endif // MBED_CONF_APP_ADAPTIVE_PERIODIC_INTERVAL
+
+    /* receiver side staleness of the peer value */
+    uint8_t _peer_battery_level = 0;
+    int _max_report_gap_ms = 0;
+    Timer _report_timer;
 
     bool _is_scanner = false;
     bool _is_connecting_or_syncing = false;
@@ -0,0 +1,315 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PERIODIC_BENCHMARK_H_
+#define PERIODIC_BENCHMARK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Framing and accounting of the periodic advertising bulk data benchmark.
+ *
+ * The transmitter fills each periodic advertising payload with frames of a
+ * numbered byte stream. Each frame is a manufacturer specific data element:
+ *
+ *   | len | 0xFF | company id (2) | configuration (1) | sequence (4) | timestamp us (4) | stream bytes |
+ *
+ * Byte i of the stream in frame n is (n + i) & 0xFF which lets the receiver
+ * check the content without knowing anything else about the transmitter.
+ *
+ * Nothing here depends on Mbed OS, time is passed in by the caller, so the
+ * same code can be driven by the BLE stack or by a simulated controller.
+ */
+namespace periodic_benchmark {
+
+/* company identifier reserved for tests by the Bluetooth SIG */
+static const uint16_t COMPANY_ID = 0xFFFF;
+
+static const uint8_t AD_TYPE_MANUFACTURER_SPECIFIC_DATA = 0xFF;
+
+/* length and type bytes of the element followed by the frame header */
+static const size_t FRAME_OVERHEAD = 2 + 2 + 1 + 4 + 4;
+
+/* frame header as seen in the value of the element */
+static const size_t HEADER_SIZE = FRAME_OVERHEAD - 2;
+
+/* an advertising data element can't be longer than this, length byte included */
+static const size_t MAX_FRAME_SIZE = 256;
+
+inline void write_u32(uint8_t *dst, uint32_t value)
+{
+    dst[0] = value;
+    dst[1] = value >> 8;
+    dst[2] = value >> 16;
+    dst[3] = value >> 24;
+}
+
+inline uint32_t read_u32(const uint8_t *src)
+{
+    return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+/**
+ * Produce the numbered byte stream.
+ */
+class Transmitter {
+public:
+    /**
+     * Fill a payload with as many frames as it can hold.
+     *
+     * @param[out] payload Buffer receiving the advertising data.
+     * @param[in] size Size of the payload to produce.
+     * @param[in] configuration Index of the configuration being measured.
+     * @param[in] now_us Current time of the transmitter in microseconds.
+     *
+     * @return Number of bytes written into the payload.
+     */
+    size_t build_payload(uint8_t *payload, size_t size, uint8_t configuration, uint32_t now_us)
+    {
+        size_t written = 0;
+
+        while (size - written > FRAME_OVERHEAD) {
+            size_t frame_size = size - written;
+            if (frame_size > MAX_FRAME_SIZE) {
+                frame_size = MAX_FRAME_SIZE;
+            }
+
+            uint8_t *frame = payload + written;
+            frame[0] = frame_size - 1;
+            frame[1] = AD_TYPE_MANUFACTURER_SPECIFIC_DATA;
+            frame[2] = COMPANY_ID & 0xFF;
+            frame[3] = COMPANY_ID >> 8;
+            frame[4] = configuration;
+            write_u32(frame + 5, _sequence);
+            write_u32(frame + 9, now_us);
+
+            for (size_t i = FRAME_OVERHEAD; i < frame_size; ++i) {
+                frame[i] = _sequence + (i - FRAME_OVERHEAD);
+            }
+
+            _sequence++;
+            _stream_bytes += frame_size - FRAME_OVERHEAD;
+            written += frame_size;
+        }
+
+        return written;
+    }
+
+    /** Restart the stream */
+    void reset()
+    {
+        _sequence = 0;
+        _stream_bytes = 0;
+    }
+
+    uint32_t frames_sent() const
+    {
+        return _sequence;
+    }
+
+    uint32_t stream_bytes() const
+    {
+        return _stream_bytes;
+    }
+
+private:
+    uint32_t _sequence = 0;
+    uint32_t _stream_bytes = 0;
+};
+
+/**
+ * Account for the frames of the stream received.
+ */
+class Receiver {
+public:
+    struct results_t {
+        uint8_t configuration;
+        uint32_t frames;
+        uint32_t lost;
+        uint32_t duplicates;
+        uint32_t out_of_order;
+        uint32_t corrupted;
+        uint32_t stream_bytes;
+        uint32_t elapsed_us;
+        /* latency above the fastest frame, clocks of the two devices aren't synchronised */
+        uint32_t latency_avg_us;
+        uint32_t latency_max_us;
+        /* bytes per second of stream data received */
+        uint32_t goodput;
+    };
+
+    /** Start accounting for a new configuration */
+    void reset(uint8_t configuration)
+    {
+        _results = results_t();
+        _results.configuration = configuration;
+        _started = false;
+        _highest_sequence = 0;
+        _received_window = 0;
+        _min_offset_us = 0;
+        _latency_sum_us = 0;
+    }
+
+    /**
+     * Account for a frame received.
+     *
+     * @param[in] type Type of the advertising data element.
+     * @param[in] value Value of the element.
+     * @param[in] size Size of the value.
+     * @param[in] now_us Current time of the receiver in microseconds.
+     *
+     * @return false if the element isn't a frame of the benchmark.
+     */
+    bool on_frame(uint8_t type, const uint8_t *value, size_t size, uint32_t now_us)
+    {
+        if (type != AD_TYPE_MANUFACTURER_SPECIFIC_DATA ||
+            size < HEADER_SIZE ||
+            (value[0] | (value[1] << 8)) != COMPANY_ID) {
+            return false;
+        }
+
+        uint8_t configuration = value[2];
+        uint32_t sequence = read_u32(value + 3);
+        uint32_t timestamp_us = read_u32(value + 7);
+
+        if (!_started || configuration != _results.configuration) {
+            /* the transmitter moved to the next configuration */
+            if (_started) {
+                _completed = results();
+                _has_completed = true;
+            }
+            reset(configuration);
+            _started = true;
+            _first_us = now_us;
+            _highest_sequence = sequence;
+            _received_window = 1;
+            account_frame(value, size, sequence, timestamp_us, now_us);
+            return true;
+        }
+
+        _results.elapsed_us = now_us - _first_us;
+
+        if (sequence > _highest_sequence) {
+            uint32_t advance = sequence - _highest_sequence;
+            _results.lost += advance - 1;
+            _received_window = advance < WINDOW_SIZE ? (_received_window << advance) | 1 : 1;
+            _highest_sequence = sequence;
+            account_frame(value, size, sequence, timestamp_us, now_us);
+            return true;
+        }
+
+        uint32_t age = _highest_sequence - sequence;
+        if (age >= WINDOW_SIZE || (_received_window & ((uint64_t)1 << age))) {
+            /* the payload hasn't been updated since the last event */
+            _results.duplicates++;
+        } else {
+            /* arrived after a later frame so it was counted as lost */
+            _results.out_of_order++;
+            _results.lost--;
+            _received_window |= (uint64_t)1 << age;
+            account_frame(value, size, sequence, timestamp_us, now_us);
+        }
+
+        return true;
+    }
+
+    /** Results of the configuration being measured */
+    results_t results() const
+    {
+        results_t results = _results;
+        if (results.frames) {
+            results.latency_avg_us = _latency_sum_us / results.frames;
+        }
+        if (results.elapsed_us) {
+            results.goodput = ((uint64_t)results.stream_bytes * 1000000) / results.elapsed_us;
+        }
+        return results;
+    }
+
+    /**
+     * Get the results of the previous configuration once the transmitter moved to the next one.
+     *
+     * @return true if results were available, they are only returned once.
+     */
+    bool take_completed(results_t &results)
+    {
+        if (!_has_completed) {
+            return false;
+        }
+        results = _completed;
+        _has_completed = false;
+        return true;
+    }
+
+    bool started() const
+    {
+        return _started;
+    }
+
+private:
+    /* number of frames below the highest sequence tracked to tell duplicates from late frames */
+    static const uint32_t WINDOW_SIZE = 64;
+
+    void account_frame(const uint8_t *value, size_t size, uint32_t sequence, uint32_t timestamp_us, uint32_t now_us)
+    {
+        const uint8_t *stream = value + HEADER_SIZE;
+        size_t stream_size = size - HEADER_SIZE;
+
+        for (size_t i = 0; i < stream_size; ++i) {
+            if (stream[i] != (uint8_t)(sequence + i)) {
+                _results.corrupted++;
+                return;
+            }
+        }
+
+        _results.frames++;
+        _results.stream_bytes += stream_size;
+
+        /* one way latency is only known up to the offset between the clocks,
+         * the smallest offset seen is taken as the zero latency reference */
+        int32_t offset_us = now_us - timestamp_us;
+        if (_results.frames == 1) {
+            _min_offset_us = offset_us;
+        } else if (offset_us < _min_offset_us) {
+            /* move the previous samples to the new reference */
+            uint32_t shift_us = _min_offset_us - offset_us;
+            _latency_sum_us += (uint64_t)shift_us * (_results.frames - 1);
+            _results.latency_max_us += shift_us;
+            _min_offset_us = offset_us;
+        }
+
+        uint32_t latency_us = offset_us - _min_offset_us;
+        _latency_sum_us += latency_us;
+        if (latency_us > _results.latency_max_us) {
+            _results.latency_max_us = latency_us;
+        }
+    }
+
+    results_t _results = results_t();
+    results_t _completed = results_t();
+    bool _has_completed = false;
+    bool _started = false;
+    uint32_t _first_us = 0;
+    uint32_t _highest_sequence = 0;
+    uint64_t _received_window = 0;
+    int32_t _min_offset_us = 0;
+    uint64_t _latency_sum_us = 0;
+};
+
+} // namespace periodic_benchmark
+
+#endif // PERIODIC_BENCHMARK_H_
@@ -0,0 +1,242 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2021 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PERIODIC_COLLECTOR_H_
+#define PERIODIC_COLLECTOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Latest value reported by each periodic advertiser a collector is synced with.
+ *
+ * Records are stored as a structure of arrays so that the fields touched on
+ * every report (value, timestamp and count) are packed together, away from the
+ * address and SID which are only needed when a new advertiser is found. Slots
+ * are kept contiguous: removing a record moves the last one in its place.
+ *
+ * Reports are matched to their record through a small open addressing index
+ * keyed by sync handle, so updating a record costs the same however many
+ * advertisers are collected.
+ *
+ * @tparam Capacity Maximum number of advertisers, the sync limit of the controller.
+ */
+template<size_t Capacity>
+class PeriodicCollectorTable {
+public:
+    static const size_t ADDRESS_SIZE = 6;
+
+    PeriodicCollectorTable()
+    {
+        clear();
+    }
+
+    /** Remove all the records */
+    void clear()
+    {
+        _size = 0;
+        memset(_index, 0, sizeof(_index));
+    }
+
+    /**
+     * Add the record of a new sync.
+     *
+     * @return false if the table is full or the sync is already in the table.
+     */
+    bool add(uint16_t sync_handle, const uint8_t *address, uint8_t sid)
+    {
+        if (_size == Capacity || find_index(sync_handle) != NOT_FOUND) {
+            return false;
+        }
+
+        size_t slot = _size++;
+        _sync_handles[slot] = sync_handle;
+        _values[slot] = 0;
+        _timestamps_ms[slot] = 0;
+        _reports[slot] = 0;
+        memcpy(_addresses[slot], address, ADDRESS_SIZE);
+        _sids[slot] = sid;
+
+        size_t i = home(sync_handle);
+        while (_index[i]) {
+            i = (i + 1) & INDEX_MASK;
+        }
+        _index[i] = slot + 1;
+
+        return true;
+    }
+
+    /**
+     * Remove the record of a sync that ended.
+     *
+     * @return false if the sync isn't in the table.
+     */
+    bool remove(uint16_t sync_handle)
+    {
+        size_t i = find_index(sync_handle);
+        if (i == NOT_FOUND) {
+            return false;
+        }
+
+        size_t slot = _index[i] - 1;
+        erase_index(i);
+
+        /* keep the slots contiguous by moving the last record in the hole */
+        size_t last = --_size;
+        if (slot != last) {
+            _sync_handles[slot] = _sync_handles[last];
+            _values[slot] = _values[last];
+            _timestamps_ms[slot] = _timestamps_ms[last];
+            _reports[slot] = _reports[last];
+            memcpy(_addresses[slot], _addresses[last], ADDRESS_SIZE);
+            _sids[slot] = _sids[last];
+            _index[find_index(_sync_handles[slot])] = slot + 1;
+        }
+
+        return true;
+    }
+
+    /**
+     * Record a value reported through a sync.
+     *
+     * @return false if the sync isn't in the table.
+     */
+    bool update(uint16_t sync_handle, uint8_t value, uint32_t now_ms)
+    {
+        size_t i = find_index(sync_handle);
+        if (i == NOT_FOUND) {
+            return false;
+        }
+
+        size_t slot = _index[i] - 1;
+        _values[slot] = value;
+        _timestamps_ms[slot] = now_ms;
+        _reports[slot]++;
+
+        return true;
+    }
+
+    /** Check if an advertising train is already collected */
+    bool contains(const uint8_t *address, uint8_t sid) const
+    {
+        for (size_t slot = 0; slot < _size; ++slot) {
+            if (_sids[slot] == sid && memcmp(_addresses[slot], address, ADDRESS_SIZE) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    bool full() const
+    {
+        return _size == Capacity;
+    }
+
+    /* accessors of the records in slot order */
+
+    uint16_t sync_handle(size_t slot) const
+    {
+        return _sync_handles[slot];
+    }
+
+    uint8_t value(size_t slot) const
+    {
+        return _values[slot];
+    }
+
+    uint32_t timestamp_ms(size_t slot) const
+    {
+        return _timestamps_ms[slot];
+    }
+
+    uint32_t reports(size_t slot) const
+    {
+        return _reports[slot];
+    }
+
+private:
+    /* smallest power of two at least twice the capacity, keeps the probe sequences short */
+    static constexpr size_t index_size(size_t size = 1)
+    {
+        return size >= 2 * Capacity ? size : index_size(size * 2);
+    }
+
+    static const size_t INDEX_SIZE = index_size();
+    static const size_t INDEX_MASK = INDEX_SIZE - 1;
+    static const size_t NOT_FOUND = INDEX_SIZE;
+
+    static size_t home(uint16_t sync_handle)
+    {
+        return (sync_handle * 40503u >> 4) & INDEX_MASK;
+    }
+
+    size_t find_index(uint16_t sync_handle) const
+    {
+        size_t i = home(sync_handle);
+        while (_index[i]) {
+            if (_sync_handles[_index[i] - 1] == sync_handle) {
+                return i;
+            }
+            i = (i + 1) & INDEX_MASK;
+        }
+        return NOT_FOUND;
+    }
+
+    /* linear probing deletion, entries after the hole move back if it is on their probe path */
+    void erase_index(size_t hole)
+    {
+        _index[hole] = 0;
+
+        size_t i = hole;
+        while (true) {
+            i = (i + 1) & INDEX_MASK;
+            if (!_index[i]) {
+                return;
+            }
+
+            size_t h = home(_sync_handles[_index[i] - 1]);
+            bool reachable = hole <= i ? (hole < h && h <= i) : (hole < h || h <= i);
+            if (!reachable) {
+                _index[hole] = _index[i];
+                _index[i] = 0;
+                hole = i;
+            }
+        }
+    }
+
+    size_t _size;
+
+    /* slot + 1 of the record of a sync handle, 0 for empty entries */
+    uint16_t _index[INDEX_SIZE];
+
+    /* hot fields, touched on every report */
+    uint16_t _sync_handles[Capacity];
+    uint8_t _values[Capacity];
+    uint32_t _timestamps_ms[Capacity];
+    uint32_t _reports[Capacity];
+
+    /* cold fields, only used when looking for new advertisers */
+    uint8_t _addresses[Capacity][ADDRESS_SIZE];
+    uint8_t _sids[Capacity];
+};
+
+#endif // PERIODIC_COLLECTOR_H_